@@ -0,0 +1,110 @@
+#include "adaptiveaa.h"
+
+#include "image.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+AdaptiveAntialiaser::AdaptiveAntialiaser(Scene &scene, unsigned maxDepth,
+                                         double threshold)
+:
+    d_scene(scene),
+    d_maxDepth(maxDepth),
+    d_threshold(threshold),
+    d_subdivided(0),
+    d_tree()
+{}
+
+void AdaptiveAntialiaser::render(Image &img)
+{
+    unsigned w = img.width();
+    unsigned h = img.height();
+
+    // Two rows of pixel corners: above and below the current pixel row
+    vector<Sample> top;
+    vector<Sample> bottom;
+    top.reserve(w + 1);
+    bottom.reserve(w + 1);
+    for (unsigned x = 0; x <= w; ++x)
+        top.push_back(sample(x, 0));
+
+    for (unsigned y = 0; y < h; ++y)
+    {
+        bottom.clear();
+        for (unsigned x = 0; x <= w; ++x)
+            bottom.push_back(sample(x, y + 1));
+
+        for (unsigned x = 0; x < w; ++x)
+        {
+            Sample const &c00 = top[x];
+            Sample const &c10 = top[x + 1];
+            Sample const &c01 = bottom[x];
+            Sample const &c11 = bottom[x + 1];
+            if (d_maxDepth != 0 && !similar(c00, c10, c01, c11))
+                ++d_subdivided;
+            img(x, y) = square(x, y, 1.0, c00, c10, c01, c11, 0);
+        }
+        swap(top, bottom);
+        d_scene.addTree(d_tree);
+        d_tree = RayTree();
+    }
+}
+
+unsigned long long AdaptiveAntialiaser::subdividedPixels() const
+{
+    return d_subdivided;
+}
+
+AdaptiveAntialiaser::Sample AdaptiveAntialiaser::sample(double x, double y)
+{
+    Sample result;
+    result.color = d_scene.tracePixel(x, y, d_tree, &result.object);
+    result.color.clamp();
+    return result;
+}
+
+Color AdaptiveAntialiaser::square(double x, double y, double size,
+                                  Sample const &c00, Sample const &c10,
+                                  Sample const &c01, Sample const &c11,
+                                  unsigned depth)
+{
+    if (depth == d_maxDepth || similar(c00, c10, c01, c11))
+        return (c00.color + c10.color + c01.color + c11.color) / 4;
+
+    // Split in four, five new samples: edge midpoints and centre
+    double half = size / 2;
+    Sample top    = sample(x + half, y);
+    Sample left   = sample(x, y + half);
+    Sample centre = sample(x + half, y + half);
+    Sample right  = sample(x + size, y + half);
+    Sample bottom = sample(x + half, y + size);
+
+    ++depth;
+    Color sum = square(x, y, half, c00, top, left, centre, depth);
+    sum += square(x + half, y, half, top, c10, centre, right, depth);
+    sum += square(x, y + half, half, left, centre, c01, bottom, depth);
+    sum += square(x + half, y + half, half, centre, right, bottom, c11, depth);
+    return sum / 4;
+}
+
+bool AdaptiveAntialiaser::similar(Sample const &c00, Sample const &c10,
+                                  Sample const &c01, Sample const &c11) const
+{
+    if (c00.object != c10.object || c00.object != c01.object
+        || c00.object != c11.object)
+        return false;
+
+    for (unsigned idx = 0; idx != 3; ++idx)
+    {
+        double lo = min(min(c00.color.data[idx], c10.color.data[idx]),
+                        min(c01.color.data[idx], c11.color.data[idx]));
+        double hi = max(max(c00.color.data[idx], c10.color.data[idx]),
+                        max(c01.color.data[idx], c11.color.data[idx]));
+        if (hi - lo > d_threshold)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef ADAPTIVEAA_H_
+#define ADAPTIVEAA_H_
+
+#include "renderstats.h"
+#include "triple.h"
+
+#include <vector>
+
+class Image;
+class Scene;
+
+// Adaptive anti-aliasing: one ray per pixel corner (shared between the
+// up to four pixels touching it). A pixel whose corners hit different
+// objects or differ too much in color is split in four, recursively, up
+// to a maximum depth. Other pixels are the average of their corners.
+class AdaptiveAntialiaser
+{
+    struct Sample
+    {
+        Color color;    // clamped
+        int object;     // index of the hit object, -1: background
+    };
+
+    Scene &d_scene;
+    unsigned d_maxDepth;
+    double d_threshold;
+    unsigned long long d_subdivided;    // pixels needing more than corners
+    RayTree d_tree;                     // rays of the current pixel row
+
+    public:
+        AdaptiveAntialiaser(Scene &scene, unsigned maxDepth, double threshold);
+
+        void render(Image &img);
+
+        unsigned long long subdividedPixels() const;
+
+    private:
+        Sample sample(double x, double y);
+
+        // color of the square at (x, y) with edge size and given corners
+        Color square(double x, double y, double size,
+                     Sample const &c00, Sample const &c10,
+                     Sample const &c01, Sample const &c11,
+                     unsigned depth);
+
+        bool similar(Sample const &c00, Sample const &c10,
+                     Sample const &c01, Sample const &c11) const;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "adaptivesampler.h"
+
+#include "image.h"
+#include "samplebuffer.h"
+#include "sampling.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace
+{
+    unsigned const MAX_FACTOR = 16;     // per pixel cap: 16x the average
+}
+
+unsigned const AdaptiveSampler::MIN_SAMPLES;
+
+AdaptiveSampler::AdaptiveSampler(Scene &scene, unsigned tileSize,
+                                 unsigned averageSamples, double threshold)
+:
+    d_scene(scene),
+    d_tileSize(tileSize),
+    d_threshold(threshold),
+    d_averageSamples(averageSamples),
+    d_maxSamples(max(MIN_SAMPLES, averageSamples * MAX_FACTOR))
+{}
+
+void AdaptiveSampler::render(Image &img, SampleBuffer &samples)
+{
+    unsigned w = img.width();
+    unsigned h = img.height();
+    unsigned long long budget = static_cast<unsigned long long>(w) * h
+                                * d_averageSamples;
+
+    // the space-filling orders are the ones giving square tiles
+    vector<Tile> tiles = tileOrder(w, h, d_tileSize, PixelOrder::MORTON);
+
+    for (unsigned idx = 0; idx != MIN_SAMPLES; ++idx)
+        for (Tile const &tile : tiles)
+            budget -= min<unsigned long long>(budget,
+                                              refineTile(tile, samples));
+
+    // Rounds: rank the tiles by noise, give the noisiest one more sample
+    // per unconverged pixel first, until the budget is spent. Converged
+    // pixels are never sampled again, so quiet tiles drop out for good.
+    vector<pair<double, Tile const *>> noisy;
+    while (budget != 0)
+    {
+        noisy.clear();
+        for (Tile const &tile : tiles)
+        {
+            double noise = tileNoise(tile, samples);
+            if (noise > 0)
+                noisy.push_back(make_pair(noise, &tile));
+        }
+        if (noisy.empty())
+            break;
+
+        vector<Tile> remaining;
+        for (auto const &entry : noisy)
+            remaining.push_back(*entry.second);
+
+        sort(noisy.begin(), noisy.end(),
+             [](pair<double, Tile const *> const &lhs,
+                pair<double, Tile const *> const &rhs)
+             {
+                 return lhs.first > rhs.first;
+             });
+
+        for (auto const &entry : noisy)
+        {
+            budget -= min<unsigned long long>(budget,
+                                              refineTile(*entry.second,
+                                                         samples));
+            if (budget == 0)
+                break;
+        }
+        tiles.swap(remaining);
+    }
+
+    samples.resolve(img);
+}
+
+void AdaptiveSampler::writeSampleMap(SampleBuffer const &samples,
+                                     string const &filename)
+{
+    unsigned most = 1;
+    for (unsigned y = 0; y < samples.height(); ++y)
+        for (unsigned x = 0; x < samples.width(); ++x)
+            most = max(most, samples.count(x, y));
+
+    Image map(samples.width(), samples.height());
+    for (unsigned y = 0; y < samples.height(); ++y)
+        for (unsigned x = 0; x < samples.width(); ++x)
+        {
+            Color grey;
+            grey.set(samples.count(x, y), most);
+            map(x, y) = grey;
+        }
+    map.write_png(filename);
+}
+
+unsigned AdaptiveSampler::refineTile(Tile const &tile, SampleBuffer &samples)
+{
+    unsigned taken = 0;
+    RayTree tree;
+    for (unsigned y = tile.y; y < tile.y + tile.height; ++y)
+    {
+        for (unsigned x = tile.x; x < tile.x + tile.width; ++x)
+        {
+            if (converged(samples, x, y))
+                continue;
+
+            double dx, dy;
+            pixelSampleOffset(samples.count(x, y), dx, dy);
+            samples.add(x, y, d_scene.tracePixel(x + dx, y + dy, tree));
+            ++taken;
+        }
+    }
+    d_scene.addTree(tree);
+    return taken;
+}
+
+double AdaptiveSampler::tileNoise(Tile const &tile,
+                                  SampleBuffer const &samples) const
+{
+    double noise = 0;
+    for (unsigned y = tile.y; y < tile.y + tile.height; ++y)
+        for (unsigned x = tile.x; x < tile.x + tile.width; ++x)
+            if (!converged(samples, x, y))
+                noise += samples.confidence(x, y);
+    return noise;
+}
+
+bool AdaptiveSampler::converged(SampleBuffer const &samples, unsigned x,
+                                unsigned y) const
+{
+    unsigned n = samples.count(x, y);
+    if (n < MIN_SAMPLES)
+        return false;
+    return n >= d_maxSamples || samples.confidence(x, y) < d_threshold;
+}
@@ -0,0 +1,52 @@
+#ifndef ADAPTIVESAMPLER_H_
+#define ADAPTIVESAMPLER_H_
+
+#include "pixelorder.h"
+
+#include <string>
+#include <vector>
+
+class Image;
+class SampleBuffer;
+class Scene;
+
+// Variance driven sampling: every pixel starts with a few samples and
+// stops as soon as the confidence interval of its mean is below the
+// noise threshold. The rest of the sample budget (average samples per
+// pixel times the number of pixels) goes to the noisiest tiles first.
+class AdaptiveSampler
+{
+    Scene &d_scene;
+    unsigned d_tileSize;
+    double d_threshold;
+    unsigned d_averageSamples;      // budget: per pixel on average
+    unsigned d_maxSamples;          // per pixel
+
+    public:
+        // samples every pixel gets before its variance is trusted, the
+        // smallest average budget
+        static unsigned const MIN_SAMPLES = 4;
+
+        AdaptiveSampler(Scene &scene, unsigned tileSize,
+                        unsigned averageSamples, double threshold);
+
+        void render(Image &img, SampleBuffer &samples);
+
+        // grey scale image of the samples spent per pixel, white is the
+        // most sampled pixel
+        static void writeSampleMap(SampleBuffer const &samples,
+                                   std::string const &filename);
+
+    private:
+        // one more sample for every unconverged pixel of the tile, returns
+        // the number of samples taken
+        unsigned refineTile(Tile const &tile, SampleBuffer &samples);
+
+        // summed confidence interval of the unconverged pixels of a tile
+        double tileNoise(Tile const &tile, SampleBuffer const &samples) const;
+
+        bool converged(SampleBuffer const &samples, unsigned x,
+                       unsigned y) const;
+};
+
+#endif
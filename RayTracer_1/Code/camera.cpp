@@ -0,0 +1,77 @@
+#include "camera.h"
+
+#include <cmath>
+
+using namespace std;
+
+Camera::Camera(Point const &eye, unsigned width, unsigned height)
+:
+    d_eye(eye),
+    d_corner(0, height, 0),
+    d_dx(1, 0, 0),
+    d_dy(0, -1, 0),
+    d_width(width),
+    d_height(height)
+{}
+
+Camera::Camera(Point const &eye, Point const &center, Vector const &up,
+               double fov, unsigned width, unsigned height)
+:
+    d_eye(eye),
+    d_width(width),
+    d_height(height)
+{
+    Vector forward = (center - eye).normalized();
+    Vector right = forward.cross(up).normalized();
+    Vector trueUp = right.cross(forward);
+
+    // image plane at distance 1, square pixels
+    double halfHeight = tan(fov * M_PI / 360.0);
+    double halfWidth = halfHeight * width / height;
+
+    d_corner = eye + forward - halfWidth * right + halfHeight * trueUp;
+    d_dx = right * (2 * halfWidth / width);
+    d_dy = -trueUp * (2 * halfHeight / height);
+}
+
+Ray Camera::ray(double x, double y) const
+{
+    Point pixel = d_corner + x * d_dx + y * d_dy;
+    return Ray(d_eye, (pixel - d_eye).normalized());
+}
+
+bool Camera::project(Point const &point, double &x, double &y) const
+{
+    // scale the eye -> point vector onto the image plane
+    Vector normal = d_dx.cross(d_dy);
+    double toPlane = (d_corner - d_eye).dot(normal);
+    double toPoint = (point - d_eye).dot(normal);
+    if (toPoint / toPlane <= 0)
+        return false;
+
+    Vector onPlane = d_eye + (point - d_eye) * (toPlane / toPoint) - d_corner;
+    x = onPlane.dot(d_dx) / d_dx.length_2();
+    y = onPlane.dot(d_dy) / d_dy.length_2();
+    return true;
+}
+
+double Camera::pixelSpread() const
+{
+    Point centre = d_corner + 0.5 * d_width * d_dx + 0.5 * d_height * d_dy;
+    return d_dx.length() / (centre - d_eye).length();
+}
+
+Point const &Camera::eye() const
+{
+    return d_eye;
+}
+
+unsigned Camera::width() const
+{
+    return d_width;
+}
+
+unsigned Camera::height() const
+{
+    return d_height;
+}
@@ -0,0 +1,46 @@
+#ifndef CAMERA_H_
+#define CAMERA_H_
+
+#include "ray.h"
+#include "triple.h"
+
+// Maps image positions to primary rays. The image plane is spanned from
+// its top left corner by one vector per pixel step in x and in y.
+class Camera
+{
+    Point d_eye;
+    Point d_corner;     // image position (0, 0)
+    Vector d_dx;        // image plane step of one pixel to the right
+    Vector d_dy;        // image plane step of one pixel down
+    unsigned d_width;
+    unsigned d_height;
+
+    public:
+        // the original set up: scene units are pixels, the image lies in
+        // the z = 0 plane with (0, 0, 0) at its bottom left corner
+        Camera(Point const &eye = Point(), unsigned width = 400,
+               unsigned height = 400);
+
+        // pinhole camera at eye looking at center, fov is the vertical
+        // field of view in degrees
+        Camera(Point const &eye, Point const &center, Vector const &up,
+               double fov, unsigned width, unsigned height);
+
+        // ray through image position (x, y), y pointing down:
+        // (x + 0.5, y + 0.5) is the centre of pixel (x, y)
+        Ray ray(double x, double y) const;
+
+        // image position of a scene point, false if the point is not in
+        // front of the eye
+        bool project(Point const &point, double &x, double &y) const;
+
+        // angle between the rays through neighbouring pixels at the
+        // image centre (radians)
+        double pixelSpread() const;
+
+        Point const &eye() const;
+        unsigned width() const;
+        unsigned height() const;
+};
+
+#endif
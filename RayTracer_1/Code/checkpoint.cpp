@@ -0,0 +1,208 @@
+#include "checkpoint.h"
+
+#include "image.h"
+#include "samplebuffer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    char const MAGIC[4] = {'R', 'T', 'C', 'P'};
+    uint32_t const VERSION = 2;
+
+    enum Mode : uint32_t
+    {
+        PLAIN = 1,
+        PROGRESSIVE = 2
+    };
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t mode;
+        uint32_t width;
+        uint32_t height;
+        uint32_t count;
+        uint64_t key;
+    };
+
+    // data written by ofstream may still be in the page cache only
+    void syncFile(string const &filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0 || fsync(fd) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            throw runtime_error("Could not sync " + filename + ".");
+        }
+        close(fd);
+    }
+
+    // the directory holding filename, so a rename in it is durable too
+    string directoryOf(string const &filename)
+    {
+        size_t slash = filename.rfind('/');
+        if (slash == string::npos)
+            return ".";
+        return slash == 0 ? "/" : filename.substr(0, slash);
+    }
+}
+
+Checkpoint::Checkpoint(string const &filename, unsigned long long key,
+                       double interval)
+:
+    d_filename(filename),
+    d_key(key),
+    d_interval(interval),
+    d_lastSave(Clock::now())
+{}
+
+bool Checkpoint::due() const
+{
+    return Clock::now() - d_lastSave >= chrono::duration<double>(d_interval);
+}
+
+void Checkpoint::save(vector<Tile> const &tiles, vector<char> const &done,
+                      Image const &img)
+{
+    write(PLAIN, img.width(), img.height(), tiles.size(),
+          [&](ostream &out)
+          {
+              out.write(done.data(), done.size());
+              for (size_t idx = 0; idx != tiles.size(); ++idx)
+              {
+                  if (!done[idx])
+                      continue;
+                  Tile const &tile = tiles[idx];
+                  for (unsigned y = tile.y; y != tile.y + tile.height; ++y)
+                      for (unsigned x = tile.x; x != tile.x + tile.width; ++x)
+                          out.write(reinterpret_cast<char const *>(
+                                        img(x, y).data), sizeof(Pixel));
+              }
+          });
+}
+
+bool Checkpoint::load(vector<Tile> const &tiles, vector<char> &done,
+                      Image &img) const
+{
+    ifstream in;
+    unsigned count = tiles.size();
+    if (!open(in, PLAIN, img.width(), img.height(), count))
+        return false;
+
+    done.assign(tiles.size(), 0);
+    in.read(done.data(), done.size());
+    for (size_t idx = 0; idx != tiles.size(); ++idx)
+    {
+        if (!done[idx])
+            continue;
+        Tile const &tile = tiles[idx];
+        Image::Tile view = img.tile(tile.x, tile.y, tile.width, tile.height);
+        for (unsigned y = 0; y != tile.height; ++y)
+            in.read(reinterpret_cast<char *>(view.row(y)),
+                    tile.width * sizeof(Pixel));
+    }
+
+    if (!in)
+        throw runtime_error(d_filename + " is truncated.");
+    return true;
+}
+
+void Checkpoint::save(unsigned spp, unsigned row,
+                      SampleBuffer const &samples)
+{
+    write(PROGRESSIVE, samples.width(), samples.height(), spp,
+          [&](ostream &out)
+          {
+              uint32_t nextRow = row;
+              out.write(reinterpret_cast<char const *>(&nextRow),
+                        sizeof nextRow);
+              samples.write(out);
+          });
+}
+
+bool Checkpoint::load(unsigned &spp, unsigned &row,
+                      SampleBuffer &samples) const
+{
+    ifstream in;
+    if (!open(in, PROGRESSIVE, samples.width(), samples.height(), spp))
+        return false;
+
+    uint32_t nextRow;
+    in.read(reinterpret_cast<char *>(&nextRow), sizeof nextRow);
+    samples.read(in);
+    if (!in || nextRow > samples.height())
+        throw runtime_error(d_filename + " is truncated.");
+    row = nextRow;
+    return true;
+}
+
+void Checkpoint::remove() const
+{
+    ::remove(d_filename.c_str());
+}
+
+void Checkpoint::write(unsigned mode, unsigned width, unsigned height,
+                       unsigned count,
+                       function<void(ostream &)> const &payload)
+{
+    string tmpname = d_filename + ".tmp";
+    {
+        ofstream out(tmpname, ios::binary);
+        if (!out)
+            throw runtime_error("Could not open " + tmpname
+                                + " for writing.");
+
+        Header header;
+        memcpy(header.magic, MAGIC, sizeof MAGIC);
+        header.version = VERSION;
+        header.mode = mode;
+        header.width = width;
+        header.height = height;
+        header.count = count;
+        header.key = d_key;
+        out.write(reinterpret_cast<char const *>(&header), sizeof header);
+        payload(out);
+
+        out.close();
+        if (!out)
+            throw runtime_error("Writing " + tmpname + " failed.");
+    }
+    syncFile(tmpname);
+    if (rename(tmpname.c_str(), d_filename.c_str()) != 0)
+        throw runtime_error("Could not replace " + d_filename + ".");
+    syncFile(directoryOf(d_filename));
+    d_lastSave = Clock::now();
+}
+
+bool Checkpoint::open(ifstream &in, unsigned mode, unsigned width,
+                      unsigned height, unsigned &count) const
+{
+    in.open(d_filename, ios::binary);
+    if (!in)
+        return false;
+
+    Header header;
+    in.read(reinterpret_cast<char *>(&header), sizeof header);
+    if (!in || memcmp(header.magic, MAGIC, sizeof MAGIC) != 0
+        || header.version != VERSION)
+        throw runtime_error(d_filename + " is not a checkpoint file.");
+    if (header.mode != mode || header.key != d_key
+        || header.width != width || header.height != height
+        || (mode == PLAIN && header.count != count))
+        throw runtime_error(d_filename + " is a checkpoint of another "
+                            "render.");
+    count = header.count;
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include "pixelorder.h"
+
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Image;
+class SampleBuffer;
+
+// Progress of a long render, saved every interval so an interrupted
+// render can be resumed: the finished tiles of a plain render with their
+// pixels, or the sample buffer of a progressive render. Files are written
+// to a temporary name, synced and renamed (then the directory is synced,
+// making the rename last), so a checkpoint is either the old or the new
+// one, never half of it.
+//
+// File layout (native byte order): "RTCP", version, mode (plain or
+// progressive), width, height, count (tiles or samples per pixel) and the
+// scene key. Plain: count done flags (bytes), then the pixels of the done
+// tiles (row major per tile, 3 floats each). Progressive: the row the
+// pass was at (uint32) and the sample buffer.
+class Checkpoint
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::string d_filename;
+    unsigned long long d_key;       // identifies the scene and options
+    double d_interval;              // seconds between saves
+    Clock::time_point d_lastSave;
+
+    public:
+        Checkpoint(std::string const &filename, unsigned long long key,
+                   double interval);
+
+        bool due() const;           // interval passed since the last save
+
+        // plain renders: which tiles are done, their pixels are in img
+        void save(std::vector<Tile> const &tiles,
+                  std::vector<char> const &done, Image const &img);
+        // false if there is no checkpoint, throws if it belongs to another
+        // render or cannot be read
+        bool load(std::vector<Tile> const &tiles, std::vector<char> &done,
+                  Image &img) const;
+
+        // progressive renders: samples holds spp + 1 samples for the
+        // pixels above row, spp for the others
+        void save(unsigned spp, unsigned row, SampleBuffer const &samples);
+        bool load(unsigned &spp, unsigned &row, SampleBuffer &samples) const;
+
+        void remove() const;        // the render is done
+
+    private:
+        void write(unsigned mode, unsigned width, unsigned height,
+                   unsigned count,
+                   std::function<void(std::ostream &)> const &payload);
+        // opens the file and checks its header, false if there is none
+        bool open(std::ifstream &in, unsigned mode, unsigned width,
+                  unsigned height, unsigned &count) const;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "coordinator.h"
+
+#include "image.h"
+#include "socketio.h"
+
+#include "json/json.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    size_t const PIPELINE = 2;          // tiles in flight per worker
+    size_t const MAX_HEADER = 4096;     // bytes of a reply line
+
+    // a tile is late after DEADLINE_FACTOR times the slowest tile so far,
+    // but not before MIN_DEADLINE
+    unsigned const DEADLINE_FACTOR = 4;
+    chrono::seconds const MIN_DEADLINE(60);
+
+    // seconds a send may block before the worker is dropped
+    unsigned const SEND_TIMEOUT = 30;
+}
+
+TileCoordinator::TileCoordinator(string const &address, string const &job,
+                                 unsigned width, unsigned height,
+                                 unsigned tileSize)
+:
+    d_address(address),
+    d_job(job + '\n'),
+    d_tiles(tileOrder(width, height, tileSize, PixelOrder::HILBERT)),
+    d_finished(d_tiles.size(), 0),
+    d_remaining(d_tiles.size()),
+    d_joined(0),
+    d_reissued(0),
+    d_slowest(Clock::duration::zero())
+{
+    for (size_t idx = 0; idx != d_tiles.size(); ++idx)
+        d_todo.push_back(idx);
+}
+
+void TileCoordinator::render(Image &img)
+{
+    int listener = listenSocket(d_address);
+    cout << "Waiting for workers on " << d_address << " to render "
+         << d_tiles.size() << " tiles...\n";
+
+    while (d_remaining != 0)
+    {
+        vector<pollfd> fds{pollfd{listener, POLLIN, 0}};
+        for (Worker const &worker : d_workers)
+            fds.push_back(pollfd{worker.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), untilLate()) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw runtime_error(string("poll: ") + strerror(errno));
+        }
+
+        // backwards, so dropping a worker does not move the ones to come
+        for (size_t idx = d_workers.size(); idx-- != 0; )
+        {
+            if (fds[idx + 1].revents == 0)
+                continue;
+            bool alive;
+            try
+            {
+                alive = receive(d_workers[idx], img);
+            }
+            catch (exception const &ex)
+            {
+                cerr << "Bad message from a worker: " << ex.what() << '\n';
+                alive = false;
+            }
+            if (!alive)
+            {
+                drop(d_workers[idx]);
+                d_workers.erase(d_workers.begin() + idx);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+            accept(listener);
+        expire();
+
+        for (size_t idx = d_workers.size(); idx-- != 0; )
+        {
+            if (!assign(d_workers[idx]))
+            {
+                drop(d_workers[idx]);
+                d_workers.erase(d_workers.begin() + idx);
+            }
+        }
+    }
+
+    for (Worker &worker : d_workers)
+    {
+        writeAll(worker.fd, "{\"done\":true}\n");
+        close(worker.fd);
+    }
+    d_workers.clear();
+    closeListener(listener, d_address);
+
+    cout << d_joined << " workers rendered " << d_tiles.size() << " tiles, "
+         << d_reissued << " tiles were handed out again.\n";
+}
+
+void TileCoordinator::accept(int listener)
+{
+    int fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0)
+        return;         // the worker gave up already, or out of files
+    setSendTimeout(fd, SEND_TIMEOUT);
+    if (!writeAll(fd, d_job))
+    {
+        close(fd);
+        return;
+    }
+    d_workers.push_back(Worker{fd, string(), false, deque<Sent>()});
+    ++d_joined;
+    cout << "Worker " << d_joined << " joined.\n";
+}
+
+bool TileCoordinator::receive(Worker &worker, Image &img)
+{
+    if (!readMore(worker.fd, worker.buffer))
+        return false;
+
+    while (true)
+    {
+        size_t newline = worker.buffer.find('\n');
+        if (newline == string::npos)
+            return worker.buffer.size() <= MAX_HEADER;
+
+        string header = worker.buffer.substr(0, newline);
+        if (!worker.ready)
+        {
+            json message = json::parse(header);
+            if (message.count("error"))
+            {
+                cerr << "Worker failed: "
+                     << message["error"].get<string>() << '\n';
+                return false;
+            }
+            worker.ready = true;
+            worker.buffer.erase(0, newline + 1);
+        }
+        else if (!handleTile(worker, header, img))
+            return true;    // wait for the rest of the pixels
+    }
+}
+
+bool TileCoordinator::handleTile(Worker &worker, string const &header,
+                                 Image &img)
+{
+    json message = json::parse(header);
+    size_t index = message.at("tile");
+    size_t bytes = message.at("bytes");
+    size_t start = header.size() + 1;
+    if (worker.buffer.size() < start + bytes)
+        return false;
+
+    auto pending = find_if(worker.tiles.begin(), worker.tiles.end(),
+                           [&](Sent const &sent)
+                           {
+                               return sent.index == index;
+                           });
+    if (pending == worker.tiles.end())
+        throw runtime_error("tile " + to_string(index) + " was not asked for");
+    Tile const &tile = d_tiles[index];
+    if (bytes != tile.width * tile.height * 3 * 8)
+        throw runtime_error("tile " + to_string(index) + " has wrong size");
+
+    char const *data = worker.buffer.data() + start;
+    Image::Tile view = img.tile(tile.x, tile.y, tile.width, tile.height);
+    for (unsigned y = 0; y != tile.height; ++y)
+    {
+        for (unsigned x = 0; x != tile.width; ++x, data += 24)
+        {
+            view(x, y) = Color(readDouble(data), readDouble(data + 8),
+                               readDouble(data + 16));
+        }
+    }
+
+    d_slowest = max(d_slowest, Clock::now() - pending->time);
+    worker.tiles.erase(pending);
+    worker.buffer.erase(0, start + bytes);
+    if (!d_finished[index])
+    {
+        d_finished[index] = 1;
+        --d_remaining;
+    }
+    return true;
+}
+
+bool TileCoordinator::assign(Worker &worker)
+{
+    while (worker.ready && worker.tiles.size() < PIPELINE && !d_todo.empty())
+    {
+        size_t index = d_todo.front();
+        d_todo.pop_front();
+        if (d_finished[index])
+            continue;       // a late copy came back after all
+        worker.tiles.push_back(Sent{index, Clock::now(), false});
+
+        Tile const &tile = d_tiles[index];
+        json request{{"tile", index}, {"x", tile.x}, {"y", tile.y},
+                     {"width", tile.width}, {"height", tile.height}};
+        if (!writeAll(worker.fd, request.dump() + '\n'))
+            return false;
+    }
+    return true;
+}
+
+void TileCoordinator::drop(Worker &worker)
+{
+    close(worker.fd);
+    // in front, so the frame fills in in order; late tiles were handed
+    // out again already
+    for (auto tile = worker.tiles.rbegin(); tile != worker.tiles.rend();
+         ++tile)
+    {
+        if (!d_finished[tile->index] && !tile->late)
+        {
+            d_todo.push_front(tile->index);
+            ++d_reissued;
+        }
+    }
+    cout << "Lost a worker, " << worker.tiles.size()
+         << " of its tiles go to others.\n";
+}
+
+TileCoordinator::Clock::duration TileCoordinator::deadline() const
+{
+    return max<Clock::duration>(MIN_DEADLINE, DEADLINE_FACTOR * d_slowest);
+}
+
+int TileCoordinator::untilLate() const
+{
+    Clock::time_point now = Clock::now();
+    Clock::duration first = Clock::duration::max();
+    for (Worker const &worker : d_workers)
+        for (Sent const &sent : worker.tiles)
+            if (!sent.late)
+                first = min(first, sent.time + deadline() - now);
+    if (first == Clock::duration::max())
+        return -1;
+    // rounded up, so the tile is late when poll returns
+    long long wait =
+        chrono::duration_cast<chrono::milliseconds>(first).count() + 1;
+    return static_cast<int>(max(wait, 0LL));
+}
+
+void TileCoordinator::expire()
+{
+    Clock::time_point now = Clock::now();
+    for (Worker &worker : d_workers)
+    {
+        for (Sent &sent : worker.tiles)
+        {
+            if (sent.late || d_finished[sent.index]
+                || now - sent.time < deadline())
+                continue;
+            // the worker keeps it: it may still come back
+            sent.late = true;
+            d_todo.push_front(sent.index);
+            ++d_reissued;
+            cout << "Tile " << sent.index << " is late, it goes to others "
+                 << "too.\n";
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef COORDINATOR_H_
+#define COORDINATOR_H_
+
+#include "pixelorder.h"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+class Image;
+
+// Distributed rendering, coordinator side: listens for worker processes
+// (see TileWorker), sends each the scene and hands out tiles of the frame
+// to them. Tiles of a worker that disconnects (dies) go to the others
+// again, and so do tiles a worker has not returned by a deadline (it may
+// hang): the first copy that comes back is used. A worker that stops
+// reading is dropped when a send to it times out. Workers may join at
+// any time.
+//
+// Protocol, one JSON object per line:
+//  coordinator: {"scene": {...}, "options": {...}}     once per worker
+//  worker:      {"ready": true} or {"error": "..."}
+//  coordinator: {"tile": index, "x": .., "y": .., "width": .., "height": ..}
+//  worker:      {"tile": index, "bytes": n} followed by n bytes: the
+//               pixels, row by row, as r, g, b doubles (little endian)
+//  coordinator: {"done": true}                         when all tiles are in
+class TileCoordinator
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Sent
+    {
+        size_t index;
+        Clock::time_point time;
+        bool late;                      // past the deadline, handed out again
+    };
+
+    struct Worker
+    {
+        int fd;
+        std::string buffer;             // received, not yet handled
+        bool ready;
+        std::deque<Sent> tiles;         // sent, result not yet received
+    };
+
+    std::string d_address;
+    std::string d_job;                  // first message to every worker
+    std::vector<Tile> d_tiles;
+    std::deque<size_t> d_todo;          // tiles not handed out
+    std::vector<char> d_finished;
+    size_t d_remaining;
+    std::vector<Worker> d_workers;
+    unsigned d_joined;
+    unsigned d_reissued;
+    Clock::duration d_slowest;          // longest time a tile took so far
+
+    public:
+        // job: the scene and render options, as one JSON line
+        TileCoordinator(std::string const &address, std::string const &job,
+                        unsigned width, unsigned height, unsigned tileSize);
+
+        // renders all tiles of img (of the frame size) on workers
+        void render(Image &img);
+
+    private:
+        void accept(int listener);
+        bool receive(Worker &worker, Image &img);   // false: drop worker
+        bool handleTile(Worker &worker, std::string const &header,
+                        Image &img);
+        bool assign(Worker &worker);
+        void drop(Worker &worker);
+        Clock::duration deadline() const;
+        // milliseconds until the next tile is late, -1: none in flight
+        int untilLate() const;
+        // hands out late tiles again
+        void expire();
+};
+
+#endif
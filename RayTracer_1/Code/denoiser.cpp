@@ -0,0 +1,208 @@
+#include "denoiser.h"
+
+#include "image.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // B3 spline, the 1D kernel of the a-trous transform
+    float const KERNEL[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4,
+                             1.0f / 16};
+
+    // Edge stopping: color differences, the power of the normals' cosine,
+    // depth differences relative to the local depth gradient and albedo
+    // differences. The color sigma stays the same in every pass: halving it
+    // each pass, as the paper does, stops the wide passes from removing the
+    // blotchy noise of a path traced image with a few samples per pixel.
+    float const SIGMA_COLOR = 0.6f;
+    unsigned const NORMAL_POWER_LOG2 = 5;           // cos^32
+    float const SIGMA_DEPTH = 1.0f;
+    float const SIGMA_ALBEDO = 0.1f;
+
+    // Luminance a sample is damped to at most while filtering. Lower
+    // values darken noisy bright areas (the mean of compressed samples is
+    // lower), higher ones spread bright paths: on scene01_path.json with 4
+    // samples per pixel 2 comes out about as close to a 256 sample render
+    // as clipping to 1 did.
+    float const DAMPED_LUMINANCE = 2;
+
+    struct Rgb
+    {
+        float r;
+        float g;
+        float b;
+    };
+
+    float distance2(Rgb const &lhs, Rgb const &rhs)
+    {
+        float dr = lhs.r - rhs.r;
+        float dg = lhs.g - rhs.g;
+        float db = lhs.b - rhs.b;
+        return dr * dr + dg * dg + db * db;
+    }
+
+    float normalWeight(DenoiseFeature const &lhs, DenoiseFeature const &rhs)
+    {
+        float cosine = lhs.normal[0] * rhs.normal[0]
+                       + lhs.normal[1] * rhs.normal[1]
+                       + lhs.normal[2] * rhs.normal[2];
+        float weight = max(cosine, 0.0f);
+        for (unsigned step = 0; step != NORMAL_POWER_LOG2; ++step)
+            weight *= weight;
+        return weight;
+    }
+
+    // c -> c / (1 + luminance / DAMPED_LUMINANCE): the colors are filtered
+    // in this range, so a rare very bright sample adds little more than
+    // DAMPED_LUMINANCE to its neighbours instead of its full value
+    Rgb compress(Color const &color)
+    {
+        float luminance = 0.2126f * color.r + 0.7152f * color.g
+                          + 0.0722f * color.b;
+        float scale = 1 / (1 + max(luminance, 0.0f) / DAMPED_LUMINANCE);
+        return Rgb{float(color.r) * scale, float(color.g) * scale,
+                   float(color.b) * scale};
+    }
+
+    // the inverse of compress. Filtered values are weighted averages of
+    // compressed ones, so their luminance stays below DAMPED_LUMINANCE.
+    Color expand(Rgb const &color)
+    {
+        float luminance = 0.2126f * color.r + 0.7152f * color.g
+                          + 0.0722f * color.b;
+        float scale = 1 / max(1 - luminance / DAMPED_LUMINANCE, 1e-6f);
+        return Color(color.r * scale, color.g * scale, color.b * scale);
+    }
+
+    float albedoDistance2(DenoiseFeature const &lhs, DenoiseFeature const &rhs)
+    {
+        Rgb const a{lhs.albedo[0], lhs.albedo[1], lhs.albedo[2]};
+        Rgb const b{rhs.albedo[0], rhs.albedo[1], rhs.albedo[2]};
+        return distance2(a, b);
+    }
+}
+
+Denoiser::Denoiser(unsigned passes, ThreadPool *pool)
+:
+    d_passes(passes),
+    d_pool(pool)
+{}
+
+unsigned Denoiser::apply(Image &img,
+                         vector<DenoiseFeature> const &features) const
+{
+    int const width = img.width();
+    int const height = img.height();
+    if (features.size() != img.size())
+        throw invalid_argument("Denoiser: features do not match the image");
+
+    // compressed first: with few samples per pixel the rare very bright
+    // paths would otherwise be spread over their neighbourhood. Unlike
+    // clipping this keeps the values above 1 for HDR output and tone
+    // mapping.
+    vector<Rgb> current(img.size());
+    for (int y = 0; y != height; ++y)
+        for (int x = 0; x != width; ++x)
+            current[y * width + x] = compress(img(x, y));
+
+    // depth change per pixel, so a tilted plane is not taken for an edge
+    vector<float> gradient(img.size());
+    auto depthAt = [&](int x, int y)
+    {
+        x = min(max(x, 0), width - 1);
+        y = min(max(y, 0), height - 1);
+        return features[y * width + x].depth;
+    };
+    for (int y = 0; y != height; ++y)
+        for (int x = 0; x != width; ++x)
+            gradient[y * width + x] =
+                0.5f * max(fabs(depthAt(x + 1, y) - depthAt(x - 1, y)),
+                           fabs(depthAt(x, y + 1) - depthAt(x, y - 1)));
+
+    // once the taps are as far apart as the image is large, further passes
+    // only reach outside it (and 1 << pass would overflow)
+    unsigned passes = 1;
+    while (passes != d_passes && (1 << (passes - 1)) < max(width, height))
+        ++passes;
+    passes = min(passes, d_passes);
+
+    vector<Rgb> next(img.size());
+    for (unsigned pass = 0; pass != passes; ++pass)
+    {
+        int const step = 1 << pass;
+
+        auto filterRow = [&](size_t row)
+        {
+            int y = row;
+            for (int x = 0; x != width; ++x)
+            {
+                size_t centre = y * width + x;
+                DenoiseFeature const &feature = features[centre];
+                Rgb const &color = current[centre];
+                if (!feature.hit)
+                {
+                    next[centre] = color;   // background is not noisy
+                    continue;
+                }
+
+                Rgb sum{0, 0, 0};
+                float total = 0;
+                for (int dy = -2; dy <= 2; ++dy)
+                {
+                    int qy = y + dy * step;
+                    if (qy < 0 || qy >= height)
+                        continue;
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        int qx = x + dx * step;
+                        if (qx < 0 || qx >= width)
+                            continue;
+                        size_t tap = qy * width + qx;
+                        DenoiseFeature const &other = features[tap];
+                        if (!other.hit)
+                            continue;
+
+                        Rgb const &sample = current[tap];
+                        float pixels = step * sqrt(float(dx * dx + dy * dy));
+                        float depth = fabs(feature.depth - other.depth)
+                                      / (SIGMA_DEPTH * gradient[centre] * pixels
+                                         + 1e-4f);
+                        float weight =
+                            KERNEL[dx + 2] * KERNEL[dy + 2]
+                            * normalWeight(feature, other)
+                            * exp(-distance2(color, sample)
+                                      / (SIGMA_COLOR * SIGMA_COLOR)
+                                  - depth
+                                  - albedoDistance2(feature, other)
+                                      / (SIGMA_ALBEDO * SIGMA_ALBEDO));
+                        sum.r += weight * sample.r;
+                        sum.g += weight * sample.g;
+                        sum.b += weight * sample.b;
+                        total += weight;
+                    }
+                }
+                // total > 0: the centre tap always counts fully
+                next[centre] = Rgb{sum.r / total, sum.g / total,
+                                   sum.b / total};
+            }
+        };
+
+        if (d_pool)
+            d_pool->parallelFor(height, filterRow);
+        else
+            for (int y = 0; y != height; ++y)
+                filterRow(y);
+        current.swap(next);
+    }
+
+    for (int y = 0; y != height; ++y)
+        for (int x = 0; x != width; ++x)
+            img(x, y) = expand(current[y * width + x]);
+    return passes;
+}
@@ -0,0 +1,44 @@
+#ifndef DENOISER_H_
+#define DENOISER_H_
+
+#include <vector>
+
+class Image;
+class ThreadPool;
+
+// Guides of the denoiser for one pixel: the first hit through the pixel
+// centre
+struct DenoiseFeature
+{
+    float normal[3];
+    float albedo[3];        // base color of the hit material
+    float depth;            // distance from the eye
+    bool hit;               // false: background
+};
+
+// Edge-aware a-trous wavelet filter (Dammertz et al., "Edge-Avoiding
+// A-Trous Wavelet Transform for fast Global Illumination Filtering"):
+// every pass blurs with a 5 x 5 B3 spline kernel whose taps are 2^pass
+// pixels apart, so a few passes cover a wide footprint. Taps count less
+// the more their color, normal, depth and albedo differ from the centre
+// pixel, which keeps object edges, creases and texture sharp while
+// sampling noise is smoothed away. Rows are filtered in parallel. Colors
+// are filtered as c / (1 + luminance), which damps bright outliers, and
+// mapped back after, so values above 1 are kept.
+class Denoiser
+{
+    unsigned d_passes;
+    ThreadPool *d_pool;     // nullptr: filter on the calling thread
+
+    public:
+        // passes beyond the one whose taps are as far apart as the image
+        // is wide or high are skipped
+        explicit Denoiser(unsigned passes, ThreadPool *pool = nullptr);
+
+        // features: one per pixel of img, row major. Returns the number
+        // of passes run.
+        unsigned apply(Image &img,
+                       std::vector<DenoiseFeature> const &features) const;
+};
+
+#endif
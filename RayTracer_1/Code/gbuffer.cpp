@@ -0,0 +1,138 @@
+#include "gbuffer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    char const MAGIC[4] = {'R', 'T', 'G', 'B'};
+    uint32_t const VERSION = 3;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint64_t key;
+    };
+
+    struct Record
+    {
+        double position[3];
+        double normal[3];
+        double view[3];
+        double texture[3];      // u, v and footprint
+        int32_t object;
+        int32_t inside;
+    };
+}
+
+GBuffer::GBuffer(unsigned width, unsigned height)
+:
+    d_pixels(width * height),
+    d_width(width),
+    d_height(height)
+{}
+
+SurfacePoint const &GBuffer::operator()(unsigned x, unsigned y) const
+{
+    return d_pixels[y * d_width + x];
+}
+
+SurfacePoint &GBuffer::operator()(unsigned x, unsigned y)
+{
+    return d_pixels[y * d_width + x];
+}
+
+unsigned GBuffer::width() const
+{
+    return d_width;
+}
+
+unsigned GBuffer::height() const
+{
+    return d_height;
+}
+
+void GBuffer::write(string const &filename, unsigned long long key) const
+{
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.version = VERSION;
+    header.width = d_width;
+    header.height = d_height;
+    header.key = key;
+    out.write(reinterpret_cast<char const *>(&header), sizeof header);
+
+    for (SurfacePoint const &pixel : d_pixels)
+    {
+        Record record;
+        memset(&record, 0, sizeof record);      // no stray padding bytes
+        memcpy(record.position, pixel.position.data, sizeof record.position);
+        memcpy(record.normal, pixel.N.data, sizeof record.normal);
+        memcpy(record.view, pixel.V.data, sizeof record.view);
+        record.texture[0] = pixel.u;
+        record.texture[1] = pixel.v;
+        record.texture[2] = pixel.footprint;
+        record.object = pixel.object;
+        record.inside = pixel.inside;
+        out.write(reinterpret_cast<char const *>(&record), sizeof record);
+    }
+
+    if (!out)
+        throw runtime_error("Writing " + filename + " failed.");
+}
+
+void GBuffer::read(string const &filename, unsigned long long &key)
+{
+    ifstream in(filename, ios::binary);
+    if (!in)
+        throw runtime_error("Could not open " + filename + " for reading.");
+
+    Header header;
+    in.read(reinterpret_cast<char *>(&header), sizeof header);
+    if (!in || memcmp(header.magic, MAGIC, sizeof MAGIC) != 0
+        || header.version != VERSION)
+        throw runtime_error(filename + " is not a G-buffer file.");
+
+    // the header is not trusted with the allocation: the records must
+    // be in the file (computed in 64 bits, so it cannot wrap around)
+    uint64_t records = static_cast<uint64_t>(header.width) * header.height;
+    streamoff start = in.tellg();
+    in.seekg(0, ios::end);
+    uint64_t available = in.tellg() - start;
+    in.seekg(start);
+    if (!in || available / sizeof(Record) < records)
+        throw runtime_error(filename + " is truncated.");
+
+    d_width = header.width;
+    d_height = header.height;
+    key = header.key;
+    d_pixels.assign(records, SurfacePoint());
+
+    for (SurfacePoint &pixel : d_pixels)
+    {
+        Record record;
+        in.read(reinterpret_cast<char *>(&record), sizeof record);
+        memcpy(pixel.position.data, record.position, sizeof record.position);
+        memcpy(pixel.N.data, record.normal, sizeof record.normal);
+        memcpy(pixel.V.data, record.view, sizeof record.view);
+        pixel.u = record.texture[0];
+        pixel.v = record.texture[1];
+        pixel.footprint = record.texture[2];
+        pixel.object = record.object;
+        pixel.inside = record.inside != 0;
+    }
+
+    if (!in)
+        throw runtime_error(filename + " is truncated.");
+}
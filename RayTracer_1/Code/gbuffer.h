@@ -0,0 +1,40 @@
+#ifndef GBUFFER_H_
+#define GBUFFER_H_
+
+#include "surfacepoint.h"
+
+#include <string>
+#include <vector>
+
+// First hits of all pixel centres of a frame, saved to disk so a scene
+// that only differs in its lights or material coefficients can be shaded
+// again without tracing primary rays.
+//
+// File layout (native byte order): "RTGB", version, width, height and
+// geometry key, followed per pixel (row major) by position, normal and
+// view vector (3 doubles each), texture coordinates and footprint (3
+// doubles), the object index (int32, -1: none) and whether the object was
+// hit from inside (int32).
+class GBuffer
+{
+    std::vector<SurfacePoint> d_pixels;
+    unsigned d_width;
+    unsigned d_height;
+
+    public:
+        GBuffer(unsigned width = 0, unsigned height = 0);
+
+        SurfacePoint const &operator()(unsigned x, unsigned y) const;
+        SurfacePoint &operator()(unsigned x, unsigned y);
+
+        unsigned width() const;
+        unsigned height() const;
+
+        // the key identifies the geometry and camera the hits belong to,
+        // both throw on I/O errors
+        void write(std::string const &filename,
+                   unsigned long long key) const;
+        void read(std::string const &filename, unsigned long long &key);
+};
+
+#endif
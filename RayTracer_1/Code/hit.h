@@ -9,6 +9,10 @@ class Hit
     public:
         double t;   // distance of hit
         Vector N;   // Normal at hit
+        double u = 0;   // texture coordinates at hit
+        double v = 0;
+        double uvScale = 0; // texture units per unit of length on the
+                            // surface (around the hit), for filtering
 
         Hit(double time, Vector const &normal)
         :
@@ -1,11 +1,56 @@
 #include "image.h"
 
 #include "lode/lodepng.h"
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 
 using namespace std;
 
+namespace
+{
+    string extension(string const &filename)
+    {
+        size_t dot = filename.rfind('.');
+        return dot == string::npos ? "" : filename.substr(dot);
+    }
+
+    // little endian, as EXR files are
+    void putLittle(vector<char> &out, uint64_t value, unsigned bytes)
+    {
+        for (unsigned idx = 0; idx != bytes; ++idx)
+            out.push_back(static_cast<char>(value >> (8 * idx)));
+    }
+
+    void putFloat(vector<char> &out, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof bits);
+        putLittle(out, bits, 4);
+    }
+
+    // EXR header attribute: name, type, size, then the value
+    void putAttribute(vector<char> &out, char const *name, char const *type,
+                      vector<char> const &value)
+    {
+        out.insert(out.end(), name, name + strlen(name) + 1);
+        out.insert(out.end(), type, type + strlen(type) + 1);
+        putLittle(out, value.size(), 4);
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    void writeFile(string const &filename, vector<char> const &bytes)
+    {
+        ofstream out(filename, ios::binary);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        if (!out)
+            throw runtime_error("Could not write " + filename + ".");
+    }
+}
+
 Image::Image(unsigned width, unsigned height)
 :
     d_pixels(width * height),
@@ -31,11 +76,11 @@ Color Image::get_pixel(unsigned x, unsigned y) const
 // Handier accessors
 // Usage: color = img(x,y);
 //        img(x,y) = color;
-Color const&Image::operator()(unsigned x, unsigned y) const
+Pixel const&Image::operator()(unsigned x, unsigned y) const
 {
     return d_pixels.at(index(x, y));
 }
-Color &Image::operator()(unsigned x, unsigned y)
+Pixel &Image::operator()(unsigned x, unsigned y)
 {
     return d_pixels.at(index(x, y));
 }
@@ -55,45 +100,154 @@ unsigned Image::size() const
     return d_width * d_height;
 }
 
+Image::Tile Image::tile(unsigned x, unsigned y, unsigned width,
+                        unsigned height)
+{
+    // written so that large arguments cannot wrap around
+    if (x > d_width || width > d_width - x || y > d_height
+        || height > d_height - y)
+        throw out_of_range("Image::tile: " + to_string(width) + " x "
+                           + to_string(height) + " at (" + to_string(x)
+                           + ", " + to_string(y) + ") is not inside the "
+                           + to_string(d_width) + " x "
+                           + to_string(d_height) + " image");
+    return Tile(d_pixels.data() + index(x, y), d_width, width, height);
+}
+
+// data() and write_pfm see the pixels as one array of floats
+static_assert(sizeof(Pixel) == 3 * sizeof(float), "Pixel has padding");
+
+float const *Image::data() const
+{
+    return d_pixels.empty() ? nullptr : d_pixels[0].data;
+}
+
 // Normalized accessors, unsignederval is (0...1, 0...1)
 // useful for texture access
-Color const &Image::colorAt(float x, float y) const
+Color Image::colorAt(float x, float y) const
 {
     return d_pixels.at(findex(x, y));
 }
 
-void Image::write_png(std::string const &filename) const
+bool isFloatImageName(string const &filename)
 {
-    vector<unsigned char> image;
-    image.reserve(size() * 4);  // reserves size (less allocations)
-    for (Color pixel : d_pixels)
+    string type = extension(filename);
+    return type == ".pfm" || type == ".exr";
+}
+
+void Image::write(string const &filename, ToneMap const &map,
+                  PngEncoder const &png) const
+{
+    string type = extension(filename);
+    if (type == ".pfm")
+        write_pfm(filename);
+    else if (type == ".exr")
+        write_exr(filename);
+    else
+        write_png(filename, map, png);
+}
+
+void Image::write_png(std::string const &filename, ToneMap const &map,
+                      PngEncoder const &png) const
+{
+    png.write(filename, *this, map);
+}
+
+// Portable float map: text header, then the rows bottom to top. A
+// negative scale means little endian floats.
+void Image::write_pfm(string const &filename) const
+{
+    uint16_t const one = 1;
+    bool little = *reinterpret_cast<unsigned char const *>(&one) == 1;
+    string header = "PF\n" + to_string(d_width) + ' ' + to_string(d_height)
+                    + (little ? "\n-1.0\n" : "\n1.0\n");
+
+    vector<char> bytes(header.begin(), header.end());
+    size_t const rowBytes = d_width * sizeof(Pixel);
+    bytes.reserve(header.size() + d_height * rowBytes);
+    for (unsigned y = d_height; y-- != 0; )
+    {
+        char const *row =
+            reinterpret_cast<char const *>(&d_pixels[index(0, y)]);
+        bytes.insert(bytes.end(), row, row + rowBytes);
+    }
+    writeFile(filename, bytes);
+}
+
+// OpenEXR, the smallest valid form: single part, scan lines of one row,
+// no compression, 32 bit float B, G and R channels (alphabetical, as the
+// format wants them)
+void Image::write_exr(string const &filename) const
+{
+    vector<char> bytes;
+    putLittle(bytes, 20000630, 4);      // magic number
+    putLittle(bytes, 2, 4);             // version 2, single part scan lines
+
+    vector<char> value;
+    for (char const *channel : {"B", "G", "R"})
     {
-        image.push_back(static_cast<unsigned char>(pixel.r * 255.0));
-        image.push_back(static_cast<unsigned char>(pixel.g * 255.0));
-        image.push_back(static_cast<unsigned char>(pixel.b * 255.0));
-        image.push_back(255);   // alpha is always 1
+        value.insert(value.end(), channel, channel + 2);
+        putLittle(value, 2, 4);         // pixel type FLOAT
+        putLittle(value, 0, 4);         // pLinear, reserved
+        putLittle(value, 1, 4);         // x and y sampling
+        putLittle(value, 1, 4);
     }
+    value.push_back(0);
+    putAttribute(bytes, "channels", "chlist", value);
+    putAttribute(bytes, "compression", "compression", vector<char>(1, 0));
+
+    value.clear();
+    putLittle(value, 0, 4);
+    putLittle(value, 0, 4);
+    putLittle(value, d_width - 1, 4);
+    putLittle(value, d_height - 1, 4);
+    putAttribute(bytes, "dataWindow", "box2i", value);
+    putAttribute(bytes, "displayWindow", "box2i", value);
+    putAttribute(bytes, "lineOrder", "lineOrder", vector<char>(1, 0));
 
-    lodepng::encode(filename, image, d_width, d_height);
+    value.clear();
+    putFloat(value, 1);
+    putAttribute(bytes, "pixelAspectRatio", "float", value);
+    putAttribute(bytes, "screenWindowWidth", "float", value);
+    value.clear();
+    putFloat(value, 0);
+    putFloat(value, 0);
+    putAttribute(bytes, "screenWindowCenter", "v2f", value);
+    bytes.push_back(0);                 // end of the header
+
+    // offset table, then per row: y, data size and the B, G, R values
+    size_t const rowBytes = 3 * 4 * d_width;
+    uint64_t offset = bytes.size() + 8 * d_height;
+    for (unsigned y = 0; y != d_height; ++y)
+    {
+        putLittle(bytes, offset, 8);
+        offset += 8 + rowBytes;
+    }
+    bytes.reserve(offset);
+    for (unsigned y = 0; y != d_height; ++y)
+    {
+        putLittle(bytes, y, 4);
+        putLittle(bytes, rowBytes, 4);
+        for (unsigned channel = 3; channel-- != 0; )
+            for (unsigned x = 0; x != d_width; ++x)
+                putFloat(bytes, d_pixels[index(x, y)].data[channel]);
+    }
+    writeFile(filename, bytes);
 }
 
 void Image::read_png(std::string const &filename)
 {
     vector<unsigned char> image;
-    lodepng::decode(image, d_width, d_height, filename);
-    d_pixels.reserve(size());
-
-    auto imgIter = image.begin();
-    while (imgIter != image.end())
+    unsigned error = lodepng::decode(image, d_width, d_height, filename);
+    if (error)
+        throw runtime_error("Could not read " + filename + ": "
+                            + lodepng_error_text(error));
+    d_pixels.resize(size());
+    for (size_t idx = 0; idx != d_pixels.size(); ++idx)
     {
-        double r = (*imgIter) / 255.0;
-        ++imgIter;
-        double g = (*imgIter) / 255.0;
-        ++imgIter;
-        double b = (*imgIter) / 255.0;
-        ++imgIter;
+        Pixel &pixel = d_pixels[idx];
+        for (unsigned channel = 0; channel != 3; ++channel)
+            pixel.data[channel] = image[4 * idx + channel] / 255.0f;
         // Ignore Alpha
-        ++imgIter;
-        d_pixels.push_back(Color(r, g, b));
     }
 }
@@ -1,18 +1,77 @@
 #ifndef IMAGE_H_
 #define IMAGE_H_
 
+#include "pngencoder.h"
+#include "tonemap.h"
 #include "triple.h"
 
 #include <string>
 #include <vector>
 
+// A pixel of an Image: linear, unclamped color in single precision, half
+// the size of a Color. Converts to and from Color, so img(x, y) = color
+// and color = img(x, y) work as before.
+struct Pixel
+{
+    union {
+        float data[3];
+        struct {
+            float r;
+            float g;
+            float b;
+        };
+    };
+
+    Pixel(Color const &color = Color());
+    operator Color() const;
+};
+
+inline Pixel::Pixel(Color const &color)
+:
+    r(color.r),
+    g(color.g),
+    b(color.b)
+{}
+
+inline Pixel::operator Color() const
+{
+    return Color(r, g, b);
+}
+
+// Float RGB framebuffer. Values are not clamped: tone mapping to 8 bit
+// happens when writing a PNG, PFM and EXR files keep the values as they
+// are.
 class Image
 {
-    std::vector<Color> d_pixels;
+    std::vector<Pixel> d_pixels;
     unsigned d_width;
     unsigned d_height;
 
     public:
+        // Writable view of a rectangle of the image, for the thread that
+        // fills it. Image::tile checks the rectangle once, accesses through
+        // the view are not checked; row(y) points at the width()
+        // contiguous pixels of the tile's row y.
+        class Tile
+        {
+            friend class Image;
+
+            Pixel *d_first;         // top left pixel
+            unsigned d_stride;      // pixels from one row to the next
+            unsigned d_width;
+            unsigned d_height;
+
+            public:
+                unsigned width() const;
+                unsigned height() const;
+                Pixel *row(unsigned y) const;
+                Pixel &operator()(unsigned x, unsigned y) const;
+
+            private:
+                Tile(Pixel *first, unsigned stride, unsigned width,
+                     unsigned height);
+        };
+
         Image(unsigned width = 0, unsigned height = 0);
         Image(std::string const &filename);
 
@@ -23,18 +82,33 @@ class Image
         // Handier accessors
         // Usage: color = img(x,y);
         //        img(x,y) = color;
-        Color const &operator()(unsigned x, unsigned y) const;
-        Color &operator()(unsigned x, unsigned y);
+        Pixel const &operator()(unsigned x, unsigned y) const;
+        Pixel &operator()(unsigned x, unsigned y);
 
         unsigned width() const;
         unsigned height() const;
         unsigned size() const;
 
+        // view of the width x height pixels from (x, y) on, throws
+        // std::out_of_range if they are not all inside the image
+        Tile tile(unsigned x, unsigned y, unsigned width, unsigned height);
+
+        // the 3 * size() channel values, row by row
+        float const *data() const;
+
         // Normalized accessors, unsignederval is (0...1, 0...1)
         // usefull for texture access
-        Color const &colorAt(float x, float y) const;
+        Color colorAt(float x, float y) const;
 
-        void write_png(std::string const &filename) const;
+        // format by extension: .pfm, .exr, PNG otherwise (encoded by png)
+        void write(std::string const &filename,
+                   ToneMap const &map = ToneMap(),
+                   PngEncoder const &png = PngEncoder()) const;
+        void write_png(std::string const &filename,
+                       ToneMap const &map = ToneMap(),
+                       PngEncoder const &png = PngEncoder()) const;
+        void write_pfm(std::string const &filename) const;
+        void write_exr(std::string const &filename) const;
         void read_png(std::string const &filename);
 
     private:
@@ -52,4 +126,36 @@ class Image
 
 };
 
+inline Image::Tile::Tile(Pixel *first, unsigned stride, unsigned width,
+                         unsigned height)
+:
+    d_first(first),
+    d_stride(stride),
+    d_width(width),
+    d_height(height)
+{}
+
+inline unsigned Image::Tile::width() const
+{
+    return d_width;
+}
+
+inline unsigned Image::Tile::height() const
+{
+    return d_height;
+}
+
+inline Pixel *Image::Tile::row(unsigned y) const
+{
+    return d_first + static_cast<size_t>(y) * d_stride;
+}
+
+inline Pixel &Image::Tile::operator()(unsigned x, unsigned y) const
+{
+    return row(y)[x];
+}
+
+// true for names Image::write keeps the float values for (.pfm, .exr)
+bool isFloatImageName(std::string const &filename);
+
 #endif
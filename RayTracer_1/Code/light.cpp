@@ -0,0 +1,67 @@
+#include "light.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // side of the grid of about samples strata, at least 2 x 2
+    unsigned gridSide(unsigned samples)
+    {
+        unsigned side = static_cast<unsigned>(lround(sqrt(samples)));
+        return side < 2 ? 2 : side;
+    }
+}
+
+Light::Light(Point const &pos, Color const &c, Vector const &side1,
+             Vector const &side2, unsigned samples)
+:
+    Light(pos, c, Shape::RECTANGLE, side1, side2, 0, gridSide(samples))
+{}
+
+Light::Light(Point const &pos, Color const &c, double r, unsigned samples)
+:
+    Light(pos, c, Shape::SPHERE, Vector(), Vector(), r, gridSide(samples))
+{}
+
+Light::Light(Point const &pos, Color const &c, Shape kind,
+             Vector const &side1, Vector const &side2, double r,
+             unsigned side)
+:
+    position(pos),
+    color(c),
+    shape(kind),
+    edge1(side1),
+    edge2(side2),
+    radius(r),
+    grid(side)
+{}
+
+Point Light::sample(Point const &from, double su, double sv) const
+{
+    switch (shape)
+    {
+        case Shape::RECTANGLE:
+            return position + (su - 0.5) * edge1 + (sv - 0.5) * edge2;
+
+        case Shape::SPHERE:
+        {
+            // uniform on the hemisphere around the direction to from
+            Vector axis = (from - position).normalized();
+            Vector helper = fabs(axis.x) > 0.5 ? Vector(0, 1, 0)
+                                               : Vector(1, 0, 0);
+            Vector u = axis.cross(helper).normalized();
+            Vector v = axis.cross(u);
+            double cosTheta = su;
+            double sinTheta = sqrt(1 - cosTheta * cosTheta);
+            double phi = 2 * M_PI * sv;
+            return position + radius * (cosTheta * axis
+                                        + sinTheta * (cos(phi) * u
+                                                      + sin(phi) * v));
+        }
+
+        default:
+            return position;
+    }
+}
@@ -11,14 +11,47 @@ typedef std::shared_ptr<Light> LightPtr;
 class Light
 {
     public:
-        Point const position;
+        // POINT lights cast hard shadows, area lights (a RECTANGLE or a
+        // SPHERE) soft ones
+        enum class Shape
+        {
+            POINT,
+            RECTANGLE,
+            SPHERE
+        };
+
+        Point const position;   // the centre of area lights
         Color const color;
+        Shape const shape;
+        Vector const edge1;     // RECTANGLE: its sides, centred on position
+        Vector const edge2;
+        double const radius;    // SPHERE
+        unsigned const grid;    // area lights: side of the square grid of
+                                // strata shadow rays are aimed at
 
         Light(Point const &pos, Color const &c)
         :
-            position(pos),
-            color(c)
+            Light(pos, c, Shape::POINT, Vector(), Vector(), 0, 1)
         {}
+
+        // a rectangle with sides edge1 and edge2, or a sphere
+        Light(Point const &pos, Color const &c, Vector const &side1,
+              Vector const &side2, unsigned samples);
+        Light(Point const &pos, Color const &c, double r, unsigned samples);
+
+        bool isArea() const
+        {
+            return shape != Shape::POINT;
+        }
+
+        // point of the light in stratum (su, sv) of [0, 1)^2. A sphere is
+        // sampled on the half facing from.
+        Point sample(Point const &from, double su, double sv) const;
+
+    private:
+        Light(Point const &pos, Color const &c, Shape kind,
+              Vector const &side1, Vector const &side2, double r,
+              unsigned side);
 };
 
 #endif
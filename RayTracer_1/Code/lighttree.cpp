@@ -0,0 +1,137 @@
+#include "lighttree.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // Lower bound of the cosine term of a node: keeps lights that cannot
+    // light the surface diffusely (they may still add a highlight)
+    // possible, which keeps the estimate unbiased.
+    double const MIN_COSINE = 0.05;
+
+    double brightness(Color const &color)
+    {
+        return max(color.r, max(color.g, color.b));
+    }
+}
+
+void LightTree::build(vector<LightPtr> const &lights)
+{
+    d_nodes.clear();
+    if (lights.empty())
+        return;
+
+    vector<unsigned> order(lights.size());
+    for (unsigned idx = 0; idx != order.size(); ++idx)
+        order[idx] = idx;
+    d_nodes.reserve(2 * lights.size() - 1);
+    build(lights, order, 0, order.size());
+}
+
+unsigned LightTree::build(vector<LightPtr> const &lights,
+                          vector<unsigned> &order, size_t begin, size_t end)
+{
+    unsigned nodeIdx = d_nodes.size();
+    d_nodes.push_back(Node());
+
+    Point lower = lights[order[begin]]->position;
+    Point upper = lower;
+    double power = 0;
+    for (size_t idx = begin; idx != end; ++idx)
+    {
+        Light const &light = *lights[order[idx]];
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            lower.data[axis] = min(lower.data[axis], light.position.data[axis]);
+            upper.data[axis] = max(upper.data[axis], light.position.data[axis]);
+        }
+        power += brightness(light.color);
+    }
+
+    Node node{lower, upper, power, order[begin], end - begin == 1};
+    if (!node.leaf)
+    {
+        // split at the median along the longest axis of the bounds
+        Vector extent = upper - lower;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                       : (extent.y > extent.z ? 1 : 2);
+        size_t middle = begin + (end - begin) / 2;
+        nth_element(order.begin() + begin, order.begin() + middle,
+                    order.begin() + end,
+                    [&](unsigned lhs, unsigned rhs)
+                    {
+                        return lights[lhs]->position.data[axis]
+                               < lights[rhs]->position.data[axis];
+                    });
+        build(lights, order, begin, middle);
+        node.index = build(lights, order, middle, end);
+    }
+    d_nodes[nodeIdx] = node;
+    return nodeIdx;
+}
+
+double LightTree::importance(Node const &node, Point const &hit,
+                             Vector const &N) const
+{
+    Point centre = 0.5 * (node.lower + node.upper);
+    Vector D = centre - hit;
+    double distance2 = D.length_2();
+    double radius2 = 0.25 * (node.upper - node.lower).length_2();
+
+    // largest cosine between N and a direction into the node's bounding
+    // sphere
+    double cosine = 1;
+    if (distance2 > radius2)
+    {
+        double cosTheta = N.dot(D) / sqrt(distance2);
+        double cosSpread = sqrt(1 - radius2 / distance2);
+        if (cosTheta < cosSpread)
+        {
+            double sinTheta = sqrt(max(0.0, 1 - cosTheta * cosTheta));
+            double sinSpread = sqrt(radius2 / distance2);
+            cosine = cosTheta * cosSpread + sinTheta * sinSpread;
+        }
+    }
+    cosine = max(cosine, MIN_COSINE);
+
+    // the lights do not fall off with distance, dividing by it anyway
+    // steers the picks to the lights around the point: in a large scene
+    // those are the ones least likely to be hidden by other objects
+    return node.power * cosine / max(max(distance2, radius2), 1e-12);
+}
+
+unsigned LightTree::sample(Point const &hit, Vector const &N, double u,
+                           double &pdf) const
+{
+    pdf = 1;
+    unsigned nodeIdx = 0;
+    while (!d_nodes[nodeIdx].leaf)
+    {
+        unsigned left = nodeIdx + 1;
+        unsigned right = d_nodes[nodeIdx].index;
+        double leftImportance = importance(d_nodes[left], hit, N);
+        double rightImportance = importance(d_nodes[right], hit, N);
+        double total = leftImportance + rightImportance;
+        double pLeft = total > 0 ? leftImportance / total : 0.5;
+
+        // reuse u inside the chosen child, so the leaves cover [0, 1) in
+        // consecutive intervals
+        if (u < pLeft)
+        {
+            u /= pLeft;
+            pdf *= pLeft;
+            nodeIdx = left;
+        }
+        else
+        {
+            u = (u - pLeft) / (1 - pLeft);
+            pdf *= 1 - pLeft;
+            nodeIdx = right;
+        }
+        u = min(u, nextafter(1.0, 0.0));
+    }
+    return d_nodes[nodeIdx].index;
+}
@@ -0,0 +1,54 @@
+#ifndef LIGHTTREE_H_
+#define LIGHTTREE_H_
+
+#include "light.h"
+#include "triple.h"
+
+#include <cstddef>
+#include <vector>
+
+// Bounding volume hierarchy over the point lights of a scene, every node
+// knowing the bounds and total power of the lights below it. Picks a
+// light for a shading point in O(log lights), with a probability that
+// favours bright lights that are close and above the surface. No light
+// gets probability zero, so weighting a picked light's contribution by
+// 1 / probability gives an unbiased estimate of the sum over all lights.
+class LightTree
+{
+    struct Node
+    {
+        Point lower;        // bounds of the lights below the node
+        Point upper;
+        double power;       // their summed brightness
+        unsigned index;     // leaf: the light, inner: the right child
+                            // (the left child follows the node)
+        bool leaf;
+    };
+
+    std::vector<Node> d_nodes;  // depth first, d_nodes[0] is the root
+
+    public:
+        void build(std::vector<LightPtr> const &lights);
+        bool empty() const;
+
+        // light for the shading point hit with normal N, u in [0, 1)
+        // selects it: stratified u give stratified lights. pdf is set to
+        // the probability of the returned light.
+        unsigned sample(Point const &hit, Vector const &N, double u,
+                        double &pdf) const;
+
+    private:
+        // subtree over order[begin, end), returns its node index
+        unsigned build(std::vector<LightPtr> const &lights,
+                       std::vector<unsigned> &order, size_t begin,
+                       size_t end);
+        double importance(Node const &node, Point const &hit,
+                          Vector const &N) const;
+};
+
+inline bool LightTree::empty() const
+{
+    return d_nodes.empty();
+}
+
+#endif
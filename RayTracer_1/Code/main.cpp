@@ -1,44 +1,245 @@
 #include "raytracer.h"
+#include "sequence.h"
+#include "server.h"
+#include "threadpool.h"
+#include "worker.h"
 
+#include <exception>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 using namespace std;
 
+namespace
+{
+    void usage(char const *program)
+    {
+        cerr << "Usage: " << program << " [options] in-file [out-file.png]\n"
+                "       " << program << " [options] --sequence dir|glob\n"
+                "       " << program << " [options] --batch manifest\n"
+                "       " << program << " [options] --serve socket\n"
+                "       " << program << " [options] --worker address\n"
+                "Options:\n"
+                "  --order scanline|morton|hilbert  pixel traversal order "
+                "(default scanline)\n"
+                "  --tile-size N                    tile edge in pixels for "
+                "morton/hilbert (default 16)\n"
+                "  --strip-height N                 render in strips of N "
+                "rows, streamed to the PNG\n"
+                "  --crop x,y,w,h                   only trace the w x h "
+                "window at (x, y)\n"
+                "  --composite frame.png            crop: paste the window "
+                "into this full frame\n"
+                "  --gbuffer-out file               save the first hits for "
+                "relighting\n"
+                "  --gbuffer-in file                relight: shade saved first "
+                "hits, no primary rays\n"
+                "  --previous old.json              incremental: only trace "
+                "what changed since old.json\n"
+                "  --previous-image old.png         incremental: the render "
+                "of old.json\n"
+                "  --sequence dir|glob              render every scene, "
+                "keeping models loaded\n"
+                "  --batch manifest                 render the \"scene.json "
+                "out.png\" lines of manifest\n"
+                "  --cache-limit MB                 sequence/batch: memory for "
+                "cached models (default no limit)\n"
+                "  --checkpoint file                save progress to file "
+                "every checkpoint interval\n"
+                "  --resume file                    like --checkpoint, first "
+                "continue from the progress in file\n"
+                "  --checkpoint-interval S          seconds between "
+                "checkpoints (default 60)\n"
+                "  --coordinate address             distributed: hand out "
+                "tiles to workers on this address\n"
+                "  --worker address                 distributed: render tiles "
+                "for the coordinator at address\n"
+                "  --serve socket                   daemon: render JSON jobs "
+                "sent to this Unix socket\n"
+                "  --max-jobs N                     daemon: jobs rendered at "
+                "once (default 2)\n"
+                "  --threads N                      worker threads, 0: one per "
+                "core (default 0)\n"
+                "  --time-budget S                  render progressively "
+                "for S seconds\n"
+                "  --flush-interval S               progressive: rewrite the "
+                "output every S seconds (default 1)\n"
+                "  --spp N                          progressive: stop at N "
+                "samples per pixel\n"
+                "  --aa-depth N                     adaptive anti-aliasing, "
+                "subdivide edge pixels N times\n"
+                "  --aa-threshold T                 adaptive anti-aliasing: "
+                "color difference to subdivide (default 0.1)\n"
+                "  --adaptive-spp N                 variance driven sampling, "
+                "N samples per pixel on average\n"
+                "  --noise-threshold E              variance driven sampling: "
+                "stop at a 95% interval of E (default 0.01)\n"
+                "  --sample-map file.png            variance driven sampling: "
+                "write the samples per pixel\n"
+                "  --shading scalar|batch           shade the hits of a tile "
+                "one by one or together (default scalar)\n"
+                "  --denoise N                      filter the noise of the "
+                "image in N a-trous passes\n"
+                "  --tonemap clamp|reinhard         PNG: compress colors "
+                "above 1 or clip them (default clamp)\n"
+                "  --exposure E                     PNG: scale colors by 2^E "
+                "first (default 0)\n"
+                "  --encoding linear|srgb           PNG: store linear or sRGB "
+                "values (default linear)\n"
+                "  --png-level 0..9                 PNG: faster (0) or smaller "
+                "(9) output (default 6)\n"
+                "  --bench-shading N                benchmark: shade the first "
+                "hits N times, no image\n";
+    }
+}
+
 int main(int argc, char *argv[])
 {
     cout << "Computer Graphics - Ray tracer\n\n";
 
-    if (argc < 2 || argc > 3)
+    RenderOptions options;
+    vector<string> files;
+    try
+    {
+        for (int idx = 1; idx < argc; ++idx)
+        {
+            string arg = argv[idx];
+            if (arg.compare(0, 2, "--") != 0)
+                files.push_back(arg);
+            else if (idx + 1 < argc)
+                parseRenderOption(arg, argv[++idx], options);
+            else
+                throw invalid_argument("missing value for " + arg);
+        }
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: " << ex.what() << '\n';
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        checkRenderOptions(options);
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: " << ex.what() << '\n';
+        return 1;
+    }
+
+    if (!options.worker.empty())
+    {
+        if (!files.empty() || !options.coordinate.empty())
+        {
+            cerr << "Error: --worker gets its scene from the coordinator\n";
+            return 1;
+        }
+        return TileWorker(options).run(options.worker) ? 0 : 1;
+    }
+
+    if (!options.serve.empty())
+    {
+        if (!files.empty() || !options.sequence.empty()
+            || !options.batch.empty())
+        {
+            cerr << "Error: --serve takes its jobs from the socket\n";
+            return 1;
+        }
+
+        try
+        {
+            RenderServer(options).serve(options.serve);
+        }
+        catch (exception const &ex)
+        {
+            cerr << "Error: " << ex.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!options.sequence.empty() || !options.batch.empty())
+    {
+        if (!files.empty() || options.crop.width > 0
+            || !options.gbufferIn.empty() || !options.gbufferOut.empty()
+            || !options.previous.empty() || !options.checkpoint.empty()
+            || (!options.sequence.empty() && !options.batch.empty()))
+        {
+            cerr << "Error: --sequence and --batch render whole frames "
+                    "only\n";
+            return 1;
+        }
+
+        vector<SequenceRenderer::Job> jobs;
+        try
+        {
+            jobs = options.batch.empty()
+                       ? SequenceRenderer::findScenes(options.sequence)
+                       : SequenceRenderer::readManifest(options.batch);
+        }
+        catch (exception const &ex)
+        {
+            cerr << "Error: " << ex.what() << '\n';
+            return 1;
+        }
+        if (jobs.empty())
+        {
+            cerr << "Error: no scenes to render\n";
+            return 1;
+        }
+        return SequenceRenderer(options).render(jobs) == 0 ? 0 : 1;
+    }
+
+    if (files.size() < 1 || files.size() > 2)
     {
-        cerr << "Usage: " << argv[0] << " in-file [out-file.png]\n";
+        usage(argv[0]);
         return 1;
     }
 
+    ThreadPool pool(options.threads);
     Raytracer raytracer;
+    raytracer.useThreadPool(pool);
 
     // read the scene
-    if (!raytracer.readScene(argv[1]))
+    if (!raytracer.readScene(files[0]))
     {
-        cerr << "Error: reading scene from " << argv[1] <<
+        cerr << "Error: reading scene from " << files[0] <<
             " failed - no output generated.\n";
         return 1;
     }
 
+    if (options.benchShading > 0)
+    {
+        raytracer.benchmarkShading(options.benchShading);
+        return 0;
+    }
+
     // determine output name
     string ofname;
-    if (argc >= 3)
+    if (files.size() >= 2)
     {
-        ofname = argv[2];   // use the provided name
+        ofname = files[1];  // use the provided name
     }
     else
     {
-        ofname = argv[1];   // replace .json with .png
+        ofname = files[0];  // replace .json with .png
         ofname.erase(ofname.begin() + ofname.find_last_of('.'), ofname.end());
         ofname += ".png";
     }
 
-    raytracer.renderToFile(ofname);
+    try
+    {
+        raytracer.renderToFile(ofname, options);
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: " << ex.what() << '\n';
+        return 1;
+    }
 
     return 0;
 }
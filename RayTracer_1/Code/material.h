@@ -3,6 +3,23 @@
 
 #include "triple.h"
 
+class Texture;
+
+// Parts of the Phong model a material needs. Scene shades every material
+// with a kernel compiled for exactly its features: no diffuse or
+// specular term (ambient only), an integer specular exponent raised by
+// repeated squaring instead of pow, and so on.
+enum ShadingFeature : unsigned
+{
+    SHADE_DIFFUSE = 1,
+    SHADE_SPECULAR = 2,
+    SHADE_INTEGER_EXPONENT = 4,     // only with SHADE_SPECULAR
+    SHADE_GENERIC = SHADE_DIFFUSE | SHADE_SPECULAR
+};
+
+// largest specular exponent raised by repeated squaring
+unsigned const MAX_INTEGER_EXPONENT = 1024;
+
 class Material
 {
     public:
@@ -11,9 +28,37 @@ class Material
         double kd;          // diffuse intensity
         double ks;          // specular intensity
         double n;           // exponent for specular highlight size
+        double kr = 0.0;    // mirror reflection
+        double kt = 0.0;    // transmission (refraction)
+        double ior = 1.0;   // index of refraction, seen from outside
+        Texture const *texture = nullptr;   // color map multiplying color,
+                                            // owned by the Raytracer
+        unsigned shading = SHADE_GENERIC;   // ShadingFeatures, see
+                                            // pickShading
 
         Material() = default;
 
+        bool traces() const     // needs reflected / refracted rays
+        {
+            return kr > 0 || kt > 0;
+        }
+
+        // sets shading to the features the material uses, call once
+        // its values are final
+        void pickShading()
+        {
+            shading = 0;
+            if (kd != 0 && (color.r != 0 || color.g != 0 || color.b != 0))
+                shading |= SHADE_DIFFUSE;
+            if (ks != 0)
+            {
+                shading |= SHADE_SPECULAR;
+                if (n >= 0 && n <= MAX_INTEGER_EXPONENT
+                    && n == static_cast<unsigned>(n))
+                    shading |= SHADE_INTEGER_EXPONENT;
+            }
+        }
+
         Material(Color const &color, double ka, double kd, double ks, double n)
         :
             color(color),
@@ -0,0 +1,91 @@
+#include "modelcache.h"
+
+#include "objloader.h"
+
+#include <iostream>
+
+using namespace std;
+
+ModelCache::ModelCache(size_t limit)
+:
+    d_limit(limit),
+    d_bytes(0),
+    d_hits(0),
+    d_misses(0),
+    d_evictions(0)
+{}
+
+ModelCache::Model ModelCache::get(string const &filename)
+{
+    {
+        lock_guard<mutex> lock(d_mutex);
+        auto found = d_models.find(filename);
+        if (found != d_models.end())
+        {
+            ++d_hits;
+            d_lru.splice(d_lru.begin(), d_lru, found->second.lru);
+            return found->second.model;
+        }
+        ++d_misses;
+    }
+
+    // load without holding the lock, other threads may use the cache
+    // meanwhile (two threads loading the same file both just load it)
+    Model model = make_shared<vector<Vertex> const>(
+                      OBJLoader(filename).vertex_data());
+    cout << "Loaded model: " << filename << " with " << model->size() / 3
+         << " triangles.\n";
+
+    lock_guard<mutex> lock(d_mutex);
+    if (d_models.count(filename) == 0)
+    {
+        d_lru.push_front(filename);
+        d_models[filename] = Entry{model, d_lru.begin()};
+        d_bytes += sizeOf(model);
+        evict();
+    }
+    return model;
+}
+
+unsigned long long ModelCache::hits() const
+{
+    lock_guard<mutex> lock(d_mutex);
+    return d_hits;
+}
+
+unsigned long long ModelCache::misses() const
+{
+    lock_guard<mutex> lock(d_mutex);
+    return d_misses;
+}
+
+unsigned long long ModelCache::evictions() const
+{
+    lock_guard<mutex> lock(d_mutex);
+    return d_evictions;
+}
+
+size_t ModelCache::bytes() const
+{
+    lock_guard<mutex> lock(d_mutex);
+    return d_bytes;
+}
+
+size_t ModelCache::sizeOf(Model const &model)
+{
+    return model->size() * sizeof(Vertex);
+}
+
+void ModelCache::evict()
+{
+    // the newest model is kept even if it alone exceeds the limit,
+    // callers still hold evicted models through their shared_ptr
+    while (d_limit != 0 && d_bytes > d_limit && d_lru.size() > 1)
+    {
+        auto found = d_models.find(d_lru.back());
+        d_bytes -= sizeOf(found->second.model);
+        d_models.erase(found);
+        d_lru.pop_back();
+        ++d_evictions;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef MODELCACHE_H_
+#define MODELCACHE_H_
+
+#include "vertex.h"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Keeps loaded OBJ models (their vertex data) in memory, so rendering
+// many scenes in one process reads every model file only once. With a
+// memory limit the least recently used models are dropped once the
+// vertex data exceeds it. Safe to use from several threads.
+class ModelCache
+{
+    public:
+        typedef std::shared_ptr<std::vector<Vertex> const> Model;
+
+    private:
+        struct Entry
+        {
+            Model model;
+            std::list<std::string>::iterator lru;  // position in d_lru
+        };
+
+        std::map<std::string, Entry> d_models;
+        std::list<std::string> d_lru;       // most recently used first
+        size_t d_limit;                     // in bytes, 0: no limit
+        size_t d_bytes;
+        unsigned long long d_hits;
+        unsigned long long d_misses;
+        unsigned long long d_evictions;
+        mutable std::mutex d_mutex;
+
+    public:
+        explicit ModelCache(size_t limit = 0);
+
+        // the model in filename, loaded on first use
+        Model get(std::string const &filename);
+
+        unsigned long long hits() const;
+        unsigned long long misses() const;
+        unsigned long long evictions() const;
+        size_t bytes() const;
+
+    private:
+        static size_t sizeOf(Model const &model);
+        void evict();                       // until d_bytes <= d_limit
+};
+
+#endif
@@ -21,6 +21,12 @@ class Object
 
         virtual Hit intersect(Ray const &ray) = 0;  // must be implemented
                                                     // in derived class
+
+        // axis aligned bounding box, false if the object is unbounded
+        virtual bool bounds(Point &lo, Point &hi) const
+        {
+            return false;
+        }
 };
 
 #endif
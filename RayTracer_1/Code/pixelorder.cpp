@@ -0,0 +1,134 @@
+#include "pixelorder.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // Smallest power of two >= value
+    unsigned nextPow2(unsigned value)
+    {
+        unsigned n = 1;
+        while (n < value)
+            n *= 2;
+        return n;
+    }
+
+    // Take every other bit of d (the even ones), compacted
+    unsigned compactBits(unsigned d)
+    {
+        unsigned result = 0;
+        for (unsigned bit = 0; d != 0; ++bit, d >>= 2)
+            result |= (d & 1) << bit;
+        return result;
+    }
+
+    // Position d on the Morton (Z-order) curve -> (x, y)
+    GridCell mortonCell(unsigned d)
+    {
+        return GridCell{compactBits(d), compactBits(d >> 1)};
+    }
+
+    // Position d on the Hilbert curve filling an n x n square -> (x, y)
+    GridCell hilbertCell(unsigned n, unsigned d)
+    {
+        unsigned x = 0;
+        unsigned y = 0;
+        for (unsigned s = 1; s < n; s *= 2)
+        {
+            unsigned rx = 1 & (d / 2);
+            unsigned ry = 1 & (d ^ rx);
+
+            // rotate the quadrant
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                swap(x, y);
+            }
+
+            x += s * rx;
+            y += s * ry;
+            d /= 4;
+        }
+        return GridCell{x, y};
+    }
+}
+
+bool parsePixelOrder(string const &name, PixelOrder &order)
+{
+    if (name == "scanline")
+        order = PixelOrder::SCANLINE;
+    else if (name == "morton")
+        order = PixelOrder::MORTON;
+    else if (name == "hilbert")
+        order = PixelOrder::HILBERT;
+    else
+        return false;
+    return true;
+}
+
+char const *pixelOrderName(PixelOrder order)
+{
+    switch (order)
+    {
+        case PixelOrder::MORTON:  return "morton";
+        case PixelOrder::HILBERT: return "hilbert";
+        default:                  return "scanline";
+    }
+}
+
+vector<GridCell> gridOrder(unsigned width, unsigned height, PixelOrder order)
+{
+    vector<GridCell> cells;
+    cells.reserve(width * height);
+
+    if (order == PixelOrder::SCANLINE)
+    {
+        for (unsigned y = 0; y < height; ++y)
+            for (unsigned x = 0; x < width; ++x)
+                cells.push_back(GridCell{x, y});
+        return cells;
+    }
+
+    unsigned n = nextPow2(max(width, height));
+    for (unsigned d = 0; d < n * n; ++d)
+    {
+        GridCell cell = order == PixelOrder::MORTON ? mortonCell(d)
+                                                    : hilbertCell(n, d);
+        if (cell.x < width && cell.y < height)
+            cells.push_back(cell);
+    }
+    return cells;
+}
+
+vector<Tile> tileOrder(unsigned width, unsigned height,
+                       unsigned tileSize, PixelOrder order)
+{
+    vector<Tile> tiles;
+
+    if (order == PixelOrder::SCANLINE)
+    {
+        for (unsigned y = 0; y < height; ++y)
+            tiles.push_back(Tile{0, y, width, 1});
+        return tiles;
+    }
+
+    unsigned tilesX = (width + tileSize - 1) / tileSize;
+    unsigned tilesY = (height + tileSize - 1) / tileSize;
+
+    tiles.reserve(tilesX * tilesY);
+    for (GridCell const &cell : gridOrder(tilesX, tilesY, order))
+    {
+        unsigned x = cell.x * tileSize;
+        unsigned y = cell.y * tileSize;
+        tiles.push_back(Tile{x, y,
+                             min(tileSize, width - x),
+                             min(tileSize, height - y)});
+    }
+    return tiles;
+}
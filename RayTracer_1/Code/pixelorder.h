@@ -0,0 +1,50 @@
+#ifndef PIXELORDER_H_
+#define PIXELORDER_H_
+
+#include <string>
+#include <vector>
+
+// Order in which the pixels of an image are traced. SCANLINE walks the
+// image row by row, MORTON and HILBERT follow a space-filling curve so
+// that rays traced shortly after each other are also close on screen
+// (and hit the same objects / triangles).
+enum class PixelOrder
+{
+    SCANLINE,
+    MORTON,
+    HILBERT
+};
+
+// "scanline", "morton" or "hilbert" -> PixelOrder, false if unknown
+bool parsePixelOrder(std::string const &name, PixelOrder &order);
+char const *pixelOrderName(PixelOrder order);
+
+// A cell of a 2D grid: a pixel inside a tile, or a tile inside an image
+struct GridCell
+{
+    unsigned x;
+    unsigned y;
+};
+
+// Rectangular block of pixels, (x, y) is the top left corner
+struct Tile
+{
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+};
+
+// All cells of a width x height grid, in the given order. Curves are
+// laid over the enclosing power of two square, cells outside the grid
+// are skipped.
+std::vector<GridCell> gridOrder(unsigned width, unsigned height,
+                                PixelOrder order);
+
+// Splits a width x height image into tiles of at most tileSize x tileSize
+// pixels, listed in the given order. SCANLINE does not tile: every image
+// row is a tile of its own.
+std::vector<Tile> tileOrder(unsigned width, unsigned height,
+                            unsigned tileSize, PixelOrder order);
+
+#endif
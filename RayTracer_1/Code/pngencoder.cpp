@@ -0,0 +1,294 @@
+#include "pngencoder.h"
+
+#include "image.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include <zlib.h>
+
+using namespace std;
+
+namespace
+{
+    size_t const CHUNK_BYTES = 1 << 18; // filtered bytes per chunk, at least
+    size_t const WINDOW = 1 << 15;      // deflate window: dictionary size
+    size_t const IDAT_SIZE = 1 << 20;   // bytes per IDAT chunk
+
+    void putUint32(vector<unsigned char> &out, unsigned long value)
+    {
+        out.push_back(value >> 24);
+        out.push_back(value >> 16);
+        out.push_back(value >> 8);
+        out.push_back(value);
+    }
+
+    unsigned char paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    // Filters a row with predict(left, up, upper left), returns the sum of
+    // the absolute (signed) filtered values
+    template <typename Predict>
+    unsigned long filterWith(unsigned char const *current,
+                             unsigned char const *previous, size_t size,
+                             unsigned char *out, Predict predict)
+    {
+        size_t const bpp = 3;
+        unsigned long sum = 0;
+        auto put = [&](size_t idx, int a, int c)
+        {
+            unsigned char value = current[idx] - predict(a, previous[idx], c);
+            out[idx] = value;
+            sum += value < 128 ? value : 256 - value;
+        };
+        // the first pixel has no left neighbours
+        for (size_t idx = 0; idx != min(bpp, size); ++idx)
+            put(idx, 0, 0);
+        for (size_t idx = bpp; idx < size; ++idx)
+            put(idx, current[idx - bpp], previous[idx - bpp]);
+        return sum;
+    }
+
+    // rows [first, first + rows) of the image
+    struct Chunk
+    {
+        unsigned first;
+        unsigned rows;
+        vector<unsigned char> filtered;     // filter byte + row, per row
+        vector<unsigned char> compressed;   // raw deflate data
+        unsigned long adler;                // of filtered
+    };
+
+    // zlib stream header for a 32K window, announcing the level
+    void putZlibHeader(vector<unsigned char> &out, int level)
+    {
+        unsigned flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        unsigned header = (0x78 << 8) | (flevel << 6);
+        header += 31 - header % 31;
+        out.push_back(header >> 8);
+        out.push_back(header);
+    }
+
+    // raw deflate of chunk.filtered, continuing the stream after
+    // dictionary, closing it if last
+    void compress(Chunk &chunk, int level, unsigned char const *dictionary,
+                  size_t dictionarySize, bool last)
+    {
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            throw runtime_error("PngEncoder: deflateInit failed");
+        if (dictionarySize != 0)
+            deflateSetDictionary(&stream, dictionary, dictionarySize);
+
+        chunk.compressed.resize(deflateBound(&stream, chunk.filtered.size())
+                                + 16);
+        stream.next_in = chunk.filtered.data();
+        stream.avail_in = chunk.filtered.size();
+        stream.next_out = chunk.compressed.data();
+        stream.avail_out = chunk.compressed.size();
+        int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool full = stream.avail_out == 0;      // output may be missing
+        chunk.compressed.resize(chunk.compressed.size() - stream.avail_out);
+        deflateEnd(&stream);
+        if (result != (last ? Z_STREAM_END : Z_OK) || full)
+            throw runtime_error("PngEncoder: deflate failed");
+
+        chunk.adler = adler32(adler32(0L, Z_NULL, 0), chunk.filtered.data(),
+                              chunk.filtered.size());
+    }
+}
+
+PngEncoder::PngEncoder(int level, ThreadPool *pool)
+:
+    d_level(level),
+    d_pool(pool)
+{
+    if (level < 0 || level > 9)
+        throw invalid_argument("PngEncoder: level " + to_string(level)
+                               + " is not in 0...9");
+}
+
+void PngEncoder::write(string const &filename, Image const &image,
+                       ToneMap const &map) const
+{
+    unsigned width = image.width();
+    unsigned height = image.height();
+    size_t rowSize = 3 * static_cast<size_t>(width);
+    if (width == 0 || height == 0)
+        throw runtime_error("Could not write " + filename
+                            + ": the image is empty");
+
+    unsigned chunkRows = max<size_t>(CHUNK_BYTES / (rowSize + 1), 1);
+    vector<Chunk> chunks;
+    for (unsigned first = 0; first < height; first += chunkRows)
+        chunks.push_back(Chunk{first, min(chunkRows, height - first), {}, {},
+                               0});
+
+    auto run = [&](function<void(size_t)> const &body)
+    {
+        if (d_pool)
+            d_pool->parallelFor(chunks.size(), body);
+        else
+            for (size_t idx = 0; idx != chunks.size(); ++idx)
+                body(idx);
+    };
+
+    // tone map and filter: a chunk also maps the row above its first
+    run([&](size_t idx)
+        {
+            Chunk &chunk = chunks[idx];
+            vector<unsigned char> previous(rowSize, 0);
+            vector<unsigned char> current(rowSize);
+            vector<unsigned char> filtered(rowSize + 1);
+            vector<unsigned char> candidate(rowSize + 1);
+            if (chunk.first != 0)
+                toneMap(image.data() + (chunk.first - 1) * rowSize, rowSize,
+                        previous.data(), map);
+
+            chunk.filtered.reserve(chunk.rows * (rowSize + 1));
+            for (unsigned y = 0; y != chunk.rows; ++y)
+            {
+                toneMap(image.data() + (chunk.first + y) * rowSize, rowSize,
+                        current.data(), map);
+                filterPngRow(current.data(), previous.data(), rowSize,
+                             filtered, candidate);
+                chunk.filtered.insert(chunk.filtered.end(), filtered.begin(),
+                                      filtered.end());
+                previous.swap(current);
+            }
+        });
+
+    // deflate, the last WINDOW bytes of the chunk before as dictionary
+    run([&](size_t idx)
+        {
+            size_t dictionarySize = 0;
+            unsigned char const *dictionary = nullptr;
+            if (idx != 0)
+            {
+                vector<unsigned char> const &before = chunks[idx - 1].filtered;
+                dictionarySize = min(before.size(), WINDOW);
+                dictionary = before.data() + before.size() - dictionarySize;
+            }
+            compress(chunks[idx], d_level, dictionary, dictionarySize,
+                     idx + 1 == chunks.size());
+        });
+
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+    writePngHeader(out, width, height);
+
+    vector<unsigned char> idat;
+    putZlibHeader(idat, d_level);
+    unsigned long adler = adler32(0L, Z_NULL, 0);
+    for (Chunk const &chunk : chunks)
+    {
+        adler = adler32_combine(adler, chunk.adler, chunk.filtered.size());
+        for (size_t pos = 0; pos != chunk.compressed.size(); )
+        {
+            size_t count = min(chunk.compressed.size() - pos,
+                               IDAT_SIZE - idat.size());
+            idat.insert(idat.end(), chunk.compressed.begin() + pos,
+                        chunk.compressed.begin() + pos + count);
+            pos += count;
+            if (idat.size() == IDAT_SIZE)
+            {
+                writePngChunk(out, "IDAT", idat.data(), idat.size());
+                idat.clear();
+            }
+        }
+    }
+    putUint32(idat, adler);
+    writePngChunk(out, "IDAT", idat.data(), idat.size());
+    writePngChunk(out, "IEND", nullptr, 0);
+
+    out.close();
+    if (!out)
+        throw runtime_error("Could not write " + filename + ".");
+}
+
+// Picks the filter with the smallest sum of absolute (signed) values,
+// the heuristic recommended by the PNG specification.
+void filterPngRow(unsigned char const *current, unsigned char const *previous,
+                  size_t size, vector<unsigned char> &filtered,
+                  vector<unsigned char> &candidate)
+{
+    filtered[0] = 0;
+    unsigned long bestSum = filterWith(current, previous, size,
+                                       filtered.data() + 1,
+                                       [](int, int, int) { return 0; });
+    auto tryFilter = [&](unsigned char type, unsigned long sum)
+    {
+        candidate[0] = type;
+        if (sum < bestSum)
+        {
+            bestSum = sum;
+            filtered.swap(candidate);
+        }
+    };
+    // (the filter functions are passed one by one, so each gets its own
+    // loop without a switch in it)
+    tryFilter(1, filterWith(current, previous, size, candidate.data() + 1,
+                            [](int a, int, int) { return a; }));
+    tryFilter(2, filterWith(current, previous, size, candidate.data() + 1,
+                            [](int, int b, int) { return b; }));
+    tryFilter(3, filterWith(current, previous, size, candidate.data() + 1,
+                            [](int a, int b, int) { return (a + b) / 2; }));
+    tryFilter(4, filterWith(current, previous, size, candidate.data() + 1,
+                            paeth));
+}
+
+void writePngChunk(ostream &out, char const *type, unsigned char const *data,
+                   size_t size)
+{
+    vector<unsigned char> head;
+    putUint32(head, size);
+    head.insert(head.end(), type, type + 4);
+
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, head.data() + 4, 4);
+    if (size != 0)
+        crc = crc32(crc, data, size);
+
+    vector<unsigned char> tail;
+    putUint32(tail, crc);
+
+    out.write(reinterpret_cast<char const *>(head.data()), head.size());
+    out.write(reinterpret_cast<char const *>(data), size);
+    out.write(reinterpret_cast<char const *>(tail.data()), tail.size());
+    if (!out)
+        throw runtime_error("PNG: write failed");
+}
+
+void writePngHeader(ostream &out, unsigned width, unsigned height)
+{
+    static unsigned char const signature[] =
+        {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.write(reinterpret_cast<char const *>(signature), sizeof signature);
+
+    vector<unsigned char> header;
+    putUint32(header, width);
+    putUint32(header, height);
+    header.push_back(8);    // bit depth
+    header.push_back(2);    // color type: RGB
+    header.push_back(0);    // compression: deflate
+    header.push_back(0);    // filter method: adaptive
+    header.push_back(0);    // no interlace
+    writePngChunk(out, "IHDR", header.data(), header.size());
+}
@@ -0,0 +1,52 @@
+#ifndef PNGENCODER_H_
+#define PNGENCODER_H_
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "tonemap.h"
+
+class Image;
+class ThreadPool;
+
+// Whole image PNG encoder (8 bit RGB) for Image::write_png. The rows are
+// cut into chunks that are tone mapped, filtered and deflated on the
+// threads of a pool. Every chunk is compressed on its own, with the end
+// of the chunk before it as dictionary, and ends in a sync flush (on a
+// byte boundary), so the chunks put one after the other form one zlib
+// stream. The checksum is combined from those of the chunks.
+class PngEncoder
+{
+    int d_level;
+    ThreadPool *d_pool;
+
+    public:
+        static int const DEFAULT_LEVEL = 6;
+
+        // level: zlib compression level, 0 (fastest, not compressed) up
+        // to 9 (smallest). Without a pool the chunks are encoded one
+        // after the other.
+        explicit PngEncoder(int level = DEFAULT_LEVEL,
+                            ThreadPool *pool = nullptr);
+
+        void write(std::string const &filename, Image const &image,
+                   ToneMap const &map = ToneMap()) const;
+};
+
+// Filters an 8 bit RGB row (previous: the row above, zeros for the
+// first one) with the PNG filter that has the smallest sum of absolute
+// (signed) values. filtered receives the filter byte and the filtered
+// row, candidate is scratch space; both hold size + 1 bytes.
+void filterPngRow(unsigned char const *current, unsigned char const *previous,
+                  size_t size, std::vector<unsigned char> &filtered,
+                  std::vector<unsigned char> &candidate);
+
+// Writes a PNG chunk (length, type, data, CRC), throws on write errors
+void writePngChunk(std::ostream &out, char const *type,
+                   unsigned char const *data, size_t size);
+
+// The PNG signature and the header chunk of an 8 bit RGB image
+void writePngHeader(std::ostream &out, unsigned width, unsigned height);
+
+#endif
@@ -0,0 +1,112 @@
+#include "pngwriter.h"
+
+#include "image.h"
+#include "pngencoder.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    size_t const IDAT_SIZE = 1 << 16;   // bytes per IDAT chunk
+}
+
+PngWriter::PngWriter(string const &filename, unsigned width, unsigned height,
+                     ToneMap const &map, int level)
+:
+    d_out(filename, ios::binary),
+    d_width(width),
+    d_height(height),
+    d_rows(0),
+    d_map(map),
+    d_previous(width * 3, 0),
+    d_current(width * 3),
+    d_filtered(width * 3 + 1),
+    d_candidate(width * 3 + 1)
+{
+    if (!d_out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+
+    d_stream.zalloc = Z_NULL;
+    d_stream.zfree = Z_NULL;
+    d_stream.opaque = Z_NULL;
+    if (deflateInit(&d_stream, level) != Z_OK)
+        throw runtime_error("PngWriter: deflateInit failed");
+
+    writePngHeader(d_out, width, height);
+}
+
+PngWriter::~PngWriter()
+{
+    deflateEnd(&d_stream);
+}
+
+void PngWriter::writeRows(Image const &strip, unsigned rows)
+{
+    if (rows == 0)
+        rows = strip.height();
+    if (strip.width() != d_width || d_rows + rows > d_height)
+        throw runtime_error("PngWriter: strip does not fit the image");
+
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        toneMap(strip.data() + 3 * y * d_width, d_current.size(),
+                d_current.data(), d_map);
+        filterRow();
+        deflate(d_filtered.data(), d_filtered.size(), Z_NO_FLUSH);
+        d_previous.swap(d_current);
+        ++d_rows;
+    }
+}
+
+void PngWriter::close()
+{
+    if (d_rows != d_height)
+        throw runtime_error("PngWriter: image is not complete");
+
+    deflate(nullptr, 0, Z_FINISH);
+    if (!d_idat.empty())
+        writeChunk("IDAT", d_idat.data(), d_idat.size());
+    d_idat.clear();
+    writeChunk("IEND", nullptr, 0);
+    d_out.close();
+    if (!d_out)
+        throw runtime_error("PngWriter: writing the image failed");
+}
+
+void PngWriter::filterRow()
+{
+    filterPngRow(d_current.data(), d_previous.data(), d_current.size(),
+                 d_filtered, d_candidate);
+}
+
+void PngWriter::deflate(unsigned char const *data, size_t size, int flush)
+{
+    unsigned char buffer[16384];
+    d_stream.next_in = const_cast<unsigned char *>(data);
+    d_stream.avail_in = size;
+    do
+    {
+        d_stream.next_out = buffer;
+        d_stream.avail_out = sizeof buffer;
+        int result = ::deflate(&d_stream, flush);
+        if (result == Z_STREAM_ERROR)
+            throw runtime_error("PngWriter: deflate failed");
+        d_idat.insert(d_idat.end(), buffer,
+                      buffer + sizeof buffer - d_stream.avail_out);
+
+        if (d_idat.size() >= IDAT_SIZE)
+        {
+            writeChunk("IDAT", d_idat.data(), d_idat.size());
+            d_idat.clear();
+        }
+    }
+    while (d_stream.avail_out == 0);
+}
+
+void PngWriter::writeChunk(char const *type, unsigned char const *data,
+                           size_t size)
+{
+    writePngChunk(d_out, type, data, size);
+}
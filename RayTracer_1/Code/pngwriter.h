@@ -0,0 +1,57 @@
+#ifndef PNGWRITER_H_
+#define PNGWRITER_H_
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "pngencoder.h"
+#include "tonemap.h"
+
+class Image;
+
+// Streaming PNG encoder: rows are filtered, compressed and written as
+// they come in, so a frame never has to be in memory as a whole.
+// Output is 8 bit RGB, tone mapped with the given ToneMap, compressed
+// with the given zlib level (0...9).
+class PngWriter
+{
+    std::ofstream d_out;
+    z_stream d_stream;
+    unsigned d_width;
+    unsigned d_height;
+    unsigned d_rows;                        // rows written so far
+    ToneMap d_map;
+
+    std::vector<unsigned char> d_previous;  // previous row (unfiltered)
+    std::vector<unsigned char> d_current;
+    std::vector<unsigned char> d_filtered;  // filter byte + filtered row
+    std::vector<unsigned char> d_candidate;
+    std::vector<unsigned char> d_idat;      // compressed data not written
+
+    public:
+        PngWriter(std::string const &filename, unsigned width,
+                  unsigned height, ToneMap const &map = ToneMap(),
+                  int level = PngEncoder::DEFAULT_LEVEL);
+        ~PngWriter();
+
+        PngWriter(PngWriter const &other) = delete;
+        PngWriter &operator=(PngWriter const &other) = delete;
+
+        // append the first rows of strip (all by default), throws on
+        // write errors or when exceeding the image height
+        void writeRows(Image const &strip, unsigned rows = 0);
+
+        // writes the remaining data, all rows must have been written
+        void close();
+
+    private:
+        void filterRow();
+        void deflate(unsigned char const *data, size_t size, int flush);
+        void writeChunk(char const *type, unsigned char const *data,
+                        size_t size);
+};
+
+#endif
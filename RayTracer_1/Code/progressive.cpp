@@ -0,0 +1,168 @@
+#include "progressive.h"
+
+#include "checkpoint.h"
+#include "image.h"
+#include "samplebuffer.h"
+#include "sampling.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    unsigned const PREVIEW_STEP = 8;    // first pass traces every 8th pixel
+
+    // Write to a temporary file first, so readers never see half an
+    // image. It keeps the extension, which selects the format.
+    void replaceFile(Image const &img, string const &filename,
+                     ToneMap const &map)
+    {
+        size_t dot = filename.rfind('.');
+        size_t slash = filename.rfind('/');
+        if (dot == string::npos || (slash != string::npos && dot < slash))
+            dot = filename.size();
+        string tmpname = filename.substr(0, dot) + ".tmp"
+                         + filename.substr(dot);
+        img.write(tmpname, map);
+        if (rename(tmpname.c_str(), filename.c_str()) != 0)
+            cerr << "Could not replace " << filename << ".\n";
+    }
+}
+
+ProgressiveRenderer::ProgressiveRenderer(Scene &scene,
+                                         RenderOptions const &options,
+                                         string const &ofname)
+:
+    d_scene(scene),
+    d_options(options),
+    d_ofname(ofname),
+    d_checkpoint(nullptr)
+{}
+
+void ProgressiveRenderer::useCheckpoint(Checkpoint &checkpoint)
+{
+    d_checkpoint = &checkpoint;
+}
+
+unsigned ProgressiveRenderer::render(Image &img)
+{
+    Clock::time_point start = Clock::now();
+    d_deadline = start + chrono::duration_cast<Clock::duration>(
+                         chrono::duration<double>(d_options.timeBudget));
+    d_lastFlush = start;
+
+    SampleBuffer samples(img.width(), img.height());
+    unsigned spp = 0;
+    unsigned row = 0;       // of the refine pass adding sample spp
+    if (d_checkpoint && d_options.resume
+        && d_checkpoint->load(spp, row, samples))
+    {
+        // checkpoints are saved during refine passes, which leave the
+        // resolved samples in img
+        cout << "Resuming at " << spp << " samples per pixel (row " << row
+             << ").\n";
+        samples.resolve(img);
+    }
+    else
+    {
+        // The coarsest pass always completes, finer ones stop at the
+        // deadline
+        for (unsigned step = PREVIEW_STEP; step != 0; step /= 2)
+            if (!previewPass(img, samples, step, step == PREVIEW_STEP))
+                return 0;
+        spp = 1;
+    }
+
+    bool finished = true;
+    while (d_options.samples == 0 || spp < d_options.samples)
+    {
+        if (!refinePass(img, samples, spp, row))
+        {
+            finished = false;
+            break;
+        }
+        ++spp;
+        row = 0;
+    }
+
+    // out of time: keep the samples for the next run
+    if (d_checkpoint && finished)
+        d_checkpoint->remove();
+    else if (d_checkpoint)
+        d_checkpoint->save(spp, row, samples);
+    return spp;
+}
+
+bool ProgressiveRenderer::previewPass(Image &img, SampleBuffer &samples,
+                                      unsigned step, bool first)
+{
+    unsigned w = img.width();
+    unsigned h = img.height();
+    for (unsigned y = 0; y < h; y += step)
+    {
+        RayTree tree;
+        for (unsigned x = 0; x < w; x += step)
+        {
+            // traced by the previous (coarser) pass already
+            if (!first && x % (2 * step) == 0 && y % (2 * step) == 0)
+                continue;
+
+            Color col = d_scene.tracePixel(x + 0.5, y + 0.5, tree);
+            samples.add(x, y, col);
+
+            // upsample: fill the step x step block owned by this pixel
+            for (unsigned by = y; by < min(y + step, h); ++by)
+                for (unsigned bx = x; bx < min(x + step, w); ++bx)
+                    img(bx, by) = col;
+        }
+        d_scene.addTree(tree);
+        if (!first && outOfTime())
+            return false;
+        flushIfDue(img);
+    }
+    return true;
+}
+
+bool ProgressiveRenderer::refinePass(Image &img, SampleBuffer &samples,
+                                     unsigned index, unsigned &row)
+{
+    unsigned w = img.width();
+    unsigned h = img.height();
+    double dx, dy;
+    pixelSampleOffset(index, dx, dy);
+    for (unsigned y = row; y < h; ++y)
+    {
+        RayTree tree;
+        for (unsigned x = 0; x < w; ++x)
+        {
+            samples.add(x, y, d_scene.tracePixel(x + dx, y + dy, tree));
+            img(x, y) = samples.mean(x, y);
+        }
+        d_scene.addTree(tree);
+        row = y + 1;
+        if (d_checkpoint && d_checkpoint->due())
+            d_checkpoint->save(index, row, samples);
+        if (outOfTime())
+            return false;
+        flushIfDue(img);
+    }
+    return true;
+}
+
+bool ProgressiveRenderer::outOfTime() const
+{
+    return Clock::now() >= d_deadline;
+}
+
+void ProgressiveRenderer::flushIfDue(Image const &img)
+{
+    Clock::time_point now = Clock::now();
+    if (now - d_lastFlush < chrono::duration<double>(d_options.flushInterval))
+        return;
+    replaceFile(img, d_ofname, d_options.toneMap);
+    d_lastFlush = now;
+}
@@ -0,0 +1,53 @@
+#ifndef PROGRESSIVE_H_
+#define PROGRESSIVE_H_
+
+#include "renderoptions.h"
+
+#include <chrono>
+#include <string>
+
+class Checkpoint;
+class Image;
+class SampleBuffer;
+class Scene;
+
+// Time-budgeted rendering: a coarse preview (one ray per 8x8 block,
+// upsampled) is refined to one ray per pixel and then to more samples per
+// pixel until the time budget of the options is spent. The output file
+// is overwritten every flush interval so there always is a usable image.
+class ProgressiveRenderer
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Scene &d_scene;
+    RenderOptions const &d_options;
+    std::string d_ofname;
+    Clock::time_point d_deadline;
+    Clock::time_point d_lastFlush;
+    Checkpoint *d_checkpoint;
+
+    public:
+        ProgressiveRenderer(Scene &scene, RenderOptions const &options,
+                            std::string const &ofname);
+
+        // save the samples every checkpoint interval (and when the time
+        // is up), continue from the saved ones if options.resume is set
+        void useCheckpoint(Checkpoint &checkpoint);
+
+        // returns the number of samples every pixel received
+        unsigned render(Image &img);
+
+    private:
+        // trace the pixels on a grid of the given step, false if out of time
+        bool previewPass(Image &img, SampleBuffer &samples, unsigned step,
+                         bool first);
+        // add sample index to every pixel from row on, false if out of
+        // time (row is then the first row left to do)
+        bool refinePass(Image &img, SampleBuffer &samples, unsigned index,
+                        unsigned &row);
+
+        bool outOfTime() const;
+        void flushIfDue(Image const &img);
+};
+
+#endif
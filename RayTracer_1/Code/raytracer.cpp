@@ -1,8 +1,21 @@
 #include "raytracer.h"
 
+#include "adaptiveaa.h"
+#include "adaptivesampler.h"
+#include "camera.h"
+#include "checkpoint.h"
+#include "coordinator.h"
+#include "denoiser.h"
+#include "gbuffer.h"
 #include "image.h"
 #include "light.h"
 #include "material.h"
+#include "modelcache.h"
+#include "pngwriter.h"
+#include "progressive.h"
+#include "samplebuffer.h"
+#include "texture.h"
+#include "threadpool.h"
 #include "triple.h"
 
 // =============================================================================
@@ -21,13 +34,283 @@
 
 #include "json/json.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <limits>
 
 using namespace std;        // no std:: required
 using json = nlohmann::json;
 
+namespace
+{
+    // Plain renders of more pixels than this are streamed in strips
+    unsigned long long const STREAM_PIXELS = 4096ULL * 4096ULL;
+    unsigned const STRIP_HEIGHT = 64;
+
+    // Edge of the tiles handed out to workers by a distributed render
+    unsigned const WORKER_TILE = 64;
+
+    // Rows of the bands a checkpointed render saves
+    unsigned const CHECKPOINT_ROWS = 64;
+
+    // Number of shading kernels, indexed by ShadingFeatures
+    unsigned const SHADING_KERNELS =
+        (SHADE_GENERIC | SHADE_INTEGER_EXPONENT) + 1;
+
+    string shadingName(unsigned features)
+    {
+        if (features == 0)
+            return "ambient";
+        string name = features & SHADE_DIFFUSE ? "diffuse" : "";
+        if (features & SHADE_SPECULAR)
+            name += name.empty() ? "specular" : "+specular";
+        if (features & SHADE_INTEGER_EXPONENT)
+            name += "(integer n)";
+        return name;
+    }
+
+    // FNV-1a, stable between runs (unlike std::hash)
+    unsigned long long hashString(string const &text)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (unsigned char ch : text)
+        {
+            hash ^= ch;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Identifies a checkpointed render: the scene and the options that
+    // change the pixels saved or the image made from them. The time
+    // budget and sample cap only say how far to go: a progressive render
+    // may be resumed with more of them.
+    unsigned long long checkpointKey(string const &sceneText,
+                                     RenderOptions const &options)
+    {
+        Tile const &crop = options.crop;
+        ToneMap const &map = options.toneMap;
+        json settings{{"crop", {crop.x, crop.y, crop.width, crop.height}},
+                      {"batch-shading", options.batchShading},
+                      {"denoise", options.denoise},
+                      {"tone-map", {static_cast<int>(map.op), map.exposure,
+                                    map.srgb}},
+                      {"aa", {options.aaDepth, options.aaThreshold}},
+                      {"adaptive", {options.adaptiveSamples,
+                                    options.noiseThreshold}}};
+        return hashString(sceneText + settings.dump());
+    }
+
+    // true if tile lies inside a width x height frame, written (like
+    // Image::tile) so that large coordinates cannot wrap around
+    bool fitsIn(Tile const &tile, unsigned width, unsigned height)
+    {
+        return tile.x <= width && tile.width <= width - tile.x
+               && tile.y <= height && tile.height <= height - tile.y;
+    }
+
+    // Marks the pixels (plus a one pixel margin) covered by the projection
+    // of a bounding box, all of them if it cannot be projected
+    void markBounds(Camera const &camera, Object const &object,
+                    vector<char> &mask)
+    {
+        unsigned w = camera.width();
+        unsigned h = camera.height();
+        double x0 = 0, y0 = 0, x1 = w, y1 = h;
+
+        Point lo, hi;
+        if (object.bounds(lo, hi))
+        {
+            x0 = y0 = numeric_limits<double>::infinity();
+            x1 = y1 = -numeric_limits<double>::infinity();
+            for (unsigned corner = 0; corner != 8; ++corner)
+            {
+                Point point(corner & 1 ? hi.x : lo.x,
+                            corner & 2 ? hi.y : lo.y,
+                            corner & 4 ? hi.z : lo.z);
+                double x, y;
+                if (!camera.project(point, x, y))
+                {
+                    x0 = y0 = 0;    // (partly) behind the eye
+                    x1 = w;
+                    y1 = h;
+                    break;
+                }
+                x0 = min(x0, x);
+                y0 = min(y0, y);
+                x1 = max(x1, x);
+                y1 = max(y1, y);
+            }
+        }
+
+        // clamp before converting, the box may be far off screen
+        auto toPixel = [](double value, unsigned limit)
+        {
+            return static_cast<unsigned>(fmax(0.0, fmin(limit, value)));
+        };
+        unsigned left   = toPixel(floor(x0) - 1, w);
+        unsigned top    = toPixel(floor(y0) - 1, h);
+        unsigned right  = toPixel(ceil(x1) + 1, w);
+        unsigned bottom = toPixel(ceil(y1) + 1, h);
+        for (unsigned y = top; y < bottom; ++y)
+            for (unsigned x = left; x < right; ++x)
+                mask[y * w + x] = 1;
+    }
+
+    // Half the extent of a light along each axis: a shadow ray may end
+    // that far from its position
+    Vector lightReach(Light const &light)
+    {
+        switch (light.shape)
+        {
+            case Light::Shape::RECTANGLE:
+                return Vector(fabs(light.edge1.x) + fabs(light.edge2.x),
+                              fabs(light.edge1.y) + fabs(light.edge2.y),
+                              fabs(light.edge1.z) + fabs(light.edge2.z)) / 2;
+            case Light::Shape::SPHERE:
+                return Vector(light.radius, light.radius, light.radius);
+            default:
+                return Vector();
+        }
+    }
+
+    // true if the segment from -> to meets the box [lo, hi] (slab test)
+    bool segmentMeetsBox(Point const &from, Point const &to, Point const &lo,
+                         Point const &hi)
+    {
+        double enter = 0;
+        double leave = 1;
+        for (unsigned axis = 0; axis != 3; ++axis)
+        {
+            double start = from.data[axis];
+            double delta = to.data[axis] - start;
+            if (delta == 0)
+            {
+                if (start < lo.data[axis] || start > hi.data[axis])
+                    return false;
+                continue;
+            }
+            double t0 = (lo.data[axis] - start) / delta;
+            double t1 = (hi.data[axis] - start) / delta;
+            enter = max(enter, min(t0, t1));
+            leave = min(leave, max(t0, t1));
+            if (enter > leave)
+                return false;
+        }
+        return true;
+    }
+
+    // Marks the pixels (plus a one pixel margin) not marked yet whose
+    // centre sees a point that has a shadow ray crossing one of the boxes
+    // (pairs of corners). A shadow ray to a point p + e of an area light
+    // lies within |e| of the one to its position p, so the boxes are
+    // widened by the reach of each light. The first hits are those of the
+    // new scene: they only differ from the old ones in marked pixels.
+    void markShadows(Scene &scene, vector<pair<Point, Point>> const &boxes,
+                     vector<char> &mask)
+    {
+        Camera const &camera = scene.getCamera();
+        unsigned w = camera.width();
+        unsigned h = camera.height();
+        double const margin = 1e-5;     // more than the offset shadow
+                                        // rays start at
+
+        vector<LightPtr> lights;
+        vector<Vector> reach;
+        for (unsigned idx = 0; idx != scene.getNumLights(); ++idx)
+        {
+            lights.push_back(scene.getLight(idx));
+            reach.push_back(lightReach(*lights.back()) + margin);
+        }
+
+        auto crossesBox = [&](Point const &hit)
+        {
+            for (size_t light = 0; light != lights.size(); ++light)
+                for (auto const &box : boxes)
+                    if (segmentMeetsBox(hit, lights[light]->position,
+                                        box.first - reach[light],
+                                        box.second + reach[light]))
+                        return true;
+            return false;
+        };
+
+        vector<char> shadow(mask.size(), 0);
+        auto row = [&](size_t y)
+        {
+            for (unsigned x = 0; x != w; ++x)
+            {
+                SurfacePoint surface;
+                if (!mask[y * w + x]
+                    && scene.intersect(camera.ray(x + 0.5, y + 0.5), surface)
+                    && crossesBox(surface.position))
+                    shadow[y * w + x] = 1;
+            }
+        };
+        if (ThreadPool *pool = scene.getThreadPool())
+            pool->parallelFor(h, row);
+        else
+            for (unsigned y = 0; y != h; ++y)
+                row(y);
+
+        for (unsigned y = 0; y != h; ++y)
+            for (unsigned x = 0; x != w; ++x)
+                if (shadow[y * w + x])
+                    for (unsigned ny = y ? y - 1 : 0; ny <= min(y + 1, h - 1);
+                         ++ny)
+                        for (unsigned nx = x ? x - 1 : 0;
+                             nx <= min(x + 1, w - 1); ++nx)
+                            mask[ny * w + nx] = 1;
+    }
+
+    void reportRays(RenderStats const &stats, double seconds,
+                    unsigned long long pixels)
+    {
+        unsigned long long rays = stats.primaryRays;
+        unsigned long long secondary = 0;
+        for (auto const &count : stats.secondaryRays)
+            secondary += count;
+        rays += secondary + stats.shadowRays;
+        cout << "Traced " << rays << " rays in " << seconds << " s ("
+             << rays / seconds << " rays/s, "
+             << static_cast<double>(rays) / pixels << " rays/pixel).\n";
+        if (stats.pathSamples != 0)
+            cout << "Path traced " << stats.pathSamples << " samples ("
+                 << stats.pathSamples / seconds << " samples/s).\n";
+        if (stats.shadowRays != 0)
+        {
+            unsigned long long blocked = stats.blockedShadowRays;
+            cout << "Shadow rays: " << stats.shadowRays << ", blocked: "
+                 << blocked << ", found by the occluder cache: "
+                 << stats.occluderCacheHits;
+            if (blocked != 0)
+                cout << " (" << 100.0 * stats.occluderCacheHits / blocked
+                     << "% hit rate)";
+            cout << ".\n";
+        }
+        if (stats.areaLightTests != 0)
+            cout << "Area light visibility: " << stats.areaLightTests
+                 << " estimates, " << stats.penumbraTests
+                 << " in a penumbra (" << 100.0 * stats.penumbraTests
+                                          / stats.areaLightTests
+                 << "%).\n";
+        if (secondary == 0)
+            return;
+
+        cout << (stats.pathSamples != 0 ? "Path bounces per depth:"
+                                        : "Reflected/refracted rays per depth:");
+        for (unsigned depth = 0; depth != MAX_TRACE_DEPTH; ++depth)
+            if (stats.secondaryRays[depth] != 0)
+                cout << ' ' << depth + 1 << ": " << stats.secondaryRays[depth];
+        cout << "\nPaths ended by max depth: " << stats.maxDepthEnds
+             << ", throughput cutoff: " << stats.cutoffEnds
+             << ", Russian roulette: " << stats.rouletteEnds << ".\n";
+    }
+}
+
 bool Raytracer::parseObjectNode(json const &node)
 {
     ObjectPtr obj = nullptr;
@@ -62,7 +345,11 @@ bool Raytracer::parseObjectNode(json const &node)
         Point position(node["position"]);
         Vector rotation(node["rotation"]);
         Vector scale(node["scale"]);
-        obj = ObjectPtr(new Mesh(filename, position, rotation, scale));
+        if (models)
+            obj = ObjectPtr(new Mesh(*models->get(filename),
+                                     position, rotation, scale));
+        else
+            obj = ObjectPtr(new Mesh(filename, position, rotation, scale));
     }
     else if (node["type"] == "quad")
     {
@@ -86,45 +373,201 @@ bool Raytracer::parseObjectNode(json const &node)
 
     // Parse material and add object to the scene
     obj->material = parseMaterialNode(node["material"]);
+    secondaryRays = secondaryRays || obj->material.traces();
+    objectNodes.push_back(node.dump());
     scene.addObject(obj);
     return true;
 }
 
+Raytracer::Raytracer()
+:
+    geometryKey(0),
+    secondaryRays(false),
+    shadows(true),
+    lightSampling(LightSampling::EXACT),
+    lightSamples(4),
+    models(nullptr)
+{}
+
+void Raytracer::useModelCache(ModelCache &cache)
+{
+    models = &cache;
+}
+
+void Raytracer::useThreadPool(ThreadPool &pool)
+{
+    scene.setThreadPool(&pool);
+}
+
+Camera Raytracer::parseCameraNode(json const &node) const
+{
+    Point eye(node["eye"]);
+    Point center(node["center"]);
+    Vector up(node["up"]);
+    double fov = node["fov"];
+
+    // bad values would give NaN rays instead of an error
+    Vector forward = center - eye;
+    if (forward.length() == 0)
+        throw runtime_error("Camera: center must differ from eye");
+    if (up.length() == 0
+        || forward.normalized().cross(up.normalized()).length() < 1e-9)
+        throw runtime_error("Camera: up must not be parallel to the view "
+                            "direction");
+    if (!(fov > 0 && fov < 180))
+        throw runtime_error("Camera: fov must be between 0 and 180");
+
+    // read as double, negative numbers do not convert to unsigned
+    double size[2] = {node["resolution"][0], node["resolution"][1]};
+    for (double value : size)
+        if (!(value >= 1 && value <= numeric_limits<unsigned>::max()))
+            throw runtime_error("Camera: resolution must be positive");
+    return Camera(eye, center, up, fov, static_cast<unsigned>(size[0]),
+                  static_cast<unsigned>(size[1]));
+}
+
 Light Raytracer::parseLightNode(json const &node) const
 {
     Point pos(node["position"]);
     Color col(node["color"]);
-    return Light(pos, col);
+    string type = node.value("type", string("point"));
+    if (type == "point")
+        return Light(pos, col);
+
+    // area lights: shadow rays in the penumbra (rounded to a square)
+    unsigned samples = node.value("samples", 16u);
+    if (samples < 4)
+        throw runtime_error("Light: area lights need at least 4 samples");
+    if (type == "rectangle")
+        return Light(pos, col, Vector(node["edge1"]), Vector(node["edge2"]),
+                     samples);
+    if (type == "sphere")
+    {
+        double radius = node["radius"];
+        if (!(radius > 0))
+            throw runtime_error("Light: radius must be positive");
+        return Light(pos, col, radius, samples);
+    }
+    throw runtime_error("Light: unknown type " + type);
 }
 
-Material Raytracer::parseMaterialNode(json const &node) const
+Material Raytracer::parseMaterialNode(json const &node)
 {
     Color color(node["color"]);
     double ka = node["ka"];
     double kd = node["kd"];
     double ks = node["ks"];
     double n  = node["n"];
-    return Material(color, ka, kd, ks, n);
+    Material material(color, ka, kd, ks, n);
+
+    // optional: reflection and refraction
+    material.kr = node.value("kr", 0.0);
+    material.kt = node.value("kt", 0.0);
+    material.ior = node.value("ior", 1.0);
+    if (material.kr < 0 || material.kt < 0 || !(material.ior > 0))
+        throw runtime_error("Material: kr and kt must be >= 0, ior > 0");
+
+    // optional: color map, loaded once per file and format
+    if (node.count("texture"))
+    {
+        string filename = node["texture"];
+        string formatName = node.value("textureFormat", "byte");
+        Texture::Format format;
+        if (!parseTextureFormat(formatName, format))
+            throw runtime_error("Material: unknown textureFormat "
+                                + formatName);
+        shared_ptr<Texture> &texture = textures[formatName + ':' + filename];
+        if (!texture)
+        {
+            texture = make_shared<Texture>(filename, format);
+            cout << "Loaded texture: " << filename << " (" << formatName
+                 << ", " << texture->levels() << " levels, "
+                 << texture->bytes() << " bytes).\n";
+        }
+        material.texture = texture.get();
+    }
+    material.pickShading();
+    return material;
+}
+
+void Raytracer::parseRecursion(json const &node)
+{
+    unsigned depth = node.value("MaxDepth", 8u);
+    double throughput = node.value("MinThroughput", 0.01);
+    unsigned roulette = node.value("RouletteDepth", 4u);
+    if (depth > MAX_TRACE_DEPTH)
+        throw runtime_error("MaxDepth can be at most "
+                            + to_string(MAX_TRACE_DEPTH));
+    if (!(throughput >= 0 && throughput <= 1) || roulette == 0)
+        throw runtime_error("MinThroughput must be in [0, 1], "
+                            "RouletteDepth at least 1");
+    scene.setRecursion(depth, throughput, roulette);
+}
+
+void Raytracer::parseIntegrator(json const &node)
+{
+    string name = node.value("Integrator", string("phong"));
+    unsigned samples = node.value("Samples", 16u);
+    if (name != "phong" && name != "path")
+        throw runtime_error("Integrator must be \"phong\" or \"path\"");
+    if (samples == 0)
+        throw runtime_error("Samples must be at least 1");
+
+    bool path = name == "path";
+    scene.setIntegrator(path ? Integrator::PATH : Integrator::PHONG, samples);
+    secondaryRays = secondaryRays || path;
+}
+
+void Raytracer::parseLightSampling(json const &node)
+{
+    string mode = node.value("LightSampling", string("exact"));
+    unsigned samples = node.value("LightSamples", 4u);
+    if (mode != "exact" && mode != "tree")
+        throw runtime_error("LightSampling must be \"exact\" or \"tree\"");
+    if (samples == 0)
+        throw runtime_error("LightSamples must be at least 1");
+    lightSampling = mode == "tree" ? LightSampling::SAMPLED
+                                   : LightSampling::EXACT;
+    lightSamples = samples;
+    scene.setLightSampling(lightSampling, lightSamples);
 }
 
 bool Raytracer::readScene(string const &ifname)
-try
 {
-    // Read and parse input json file
     ifstream infile(ifname);
-    if (!infile) throw runtime_error("Could not open input file for reading.");
+    if (!infile)
+    {
+        cerr << "Could not open input file for reading.\n";
+        return false;
+    }
+    return readScene(infile);
+}
+
+bool Raytracer::readScene(istream &in)
+try
+{
+    // Read and parse input json
     json jsonscene;
-    infile >> jsonscene;
+    in >> jsonscene;
 
 // =============================================================================
 // -- Read your scene data in this section -------------------------------------
 // =============================================================================
 
-    Point eye(jsonscene["Eye"]);
-    scene.setEye(eye);
+    if (jsonscene.count("Camera"))
+        scene.setCamera(parseCameraNode(jsonscene["Camera"]));
+    else
+        scene.setCamera(Camera(Point(jsonscene["Eye"])));
+
+    parseRecursion(jsonscene);
+    parseIntegrator(jsonscene);
+
+    shadows = jsonscene.value("Shadows", true);
+    scene.setShadows(shadows);
 
     for (auto const &lightNode : jsonscene["Lights"])
         scene.addLight(parseLightNode(lightNode));
+    parseLightSampling(jsonscene);
 
     unsigned objCount = 0;
     for (auto const &objectNode : jsonscene["Objects"])
@@ -133,6 +576,17 @@ try
 
     cout << "Parsed " << objCount << " objects.\n";
 
+    // Everything but lights and materials: what primary hits depend on
+    json geometry = jsonscene["Objects"];
+    for (auto &objectNode : geometry)
+        objectNode.erase("material");
+    json const &view = jsonscene.count("Camera") ? jsonscene["Camera"]
+                                                 : jsonscene["Eye"];
+    sceneText = jsonscene.dump();
+    viewNode = view.dump();
+    lightNodes = jsonscene["Lights"].dump();
+    geometryKey = hashString(viewNode + geometry.dump());
+
 // =============================================================================
 // -- End of scene data reading ------------------------------------------------
 // =============================================================================
@@ -145,13 +599,503 @@ catch (exception const &ex)
     return false;
 }
 
-void Raytracer::renderToFile(string const &ofname)
+void Raytracer::renderToFile(string const &ofname,
+                             RenderOptions const &options)
 {
-    // TODO: the size may be a settings in your file
-    Image img(400, 400);
-    cout << "Tracing...\n";
-    scene.render(img);
+    Camera const &camera = scene.getCamera();
+    unsigned long long pixels =
+        static_cast<unsigned long long>(camera.width()) * camera.height();
+    bool plain = options.timeBudget <= 0 && options.aaDepth == 0
+                 && options.adaptiveSamples == 0;
+    if (options.denoise > 0
+        && (!options.previous.empty() || options.crop.width > 0
+            || !options.gbufferIn.empty() || !options.gbufferOut.empty()
+            || !options.coordinate.empty() || options.stripHeight > 0
+            || (plain && !options.checkpoint.empty())))
+        throw runtime_error("Denoising needs the whole frame in memory: "
+                            "no incremental, cropped, G-buffer, distributed, "
+                            "strip or checkpointed plain renders.");
+    if (!options.previous.empty())
+    {
+        if (!plain || options.crop.width > 0)
+            throw runtime_error("Incremental renders must be plain renders.");
+        renderIncremental(ofname, options);
+        return;
+    }
+    if (!options.checkpoint.empty()
+        && (options.aaDepth > 0 || options.adaptiveSamples > 0
+            || options.crop.width > 0 || !options.previous.empty()
+            || !options.gbufferIn.empty() || !options.gbufferOut.empty()
+            || !options.coordinate.empty()))
+        throw runtime_error("Checkpoints only work for plain and "
+                            "progressive renders.");
+    if (!options.checkpoint.empty() && plain)
+    {
+        renderCheckpointed(ofname, options);
+        return;
+    }
+    if (!options.coordinate.empty())
+    {
+        if (!plain || options.crop.width > 0)
+            throw runtime_error("Distributed renders must be plain renders.");
+        renderDistributed(ofname, options);
+        return;
+    }
+    if (!options.gbufferIn.empty() || !options.gbufferOut.empty())
+    {
+        if (!plain || options.crop.width > 0)
+            throw runtime_error("G-buffers only work for plain renders.");
+        renderGBuffer(ofname, options);
+        return;
+    }
+    if (options.crop.width > 0)
+    {
+        if (!plain)
+            throw runtime_error("Cropping only works for plain renders.");
+        renderCrop(ofname, options);
+        return;
+    }
+    if (options.stripHeight > 0 && isFloatImageName(ofname))
+        throw runtime_error("Strips are only written as PNG.");
+    if (plain && options.denoise == 0 && !isFloatImageName(ofname)
+        && (options.stripHeight > 0 || pixels > STREAM_PIXELS))
+    {
+        renderStrips(ofname, options);
+        return;
+    }
+
+    Image img = renderImage(ofname, options);
+
     cout << "Writing image to " << ofname << "...\n";
-    img.write_png(ofname);
+    writeImage(img, ofname, options);
     cout << "Done.\n";
 }
+
+Image Raytracer::renderImage(string const &ofname,
+                             RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    Image img(camera.width(), camera.height());
+    auto start = chrono::steady_clock::now();
+    if (options.timeBudget > 0)
+    {
+        cout << "Tracing progressively for " << options.timeBudget
+             << " s...\n";
+        ProgressiveRenderer progressive(scene, options, ofname);
+        Checkpoint checkpoint(options.checkpoint,
+                              checkpointKey(sceneText, options),
+                              options.checkpointInterval);
+        if (!options.checkpoint.empty())
+            progressive.useCheckpoint(checkpoint);
+        unsigned spp = progressive.render(img);
+        cout << "Reached " << spp << " samples per pixel.\n";
+    }
+    else if (options.aaDepth > 0)
+    {
+        cout << "Tracing with adaptive anti-aliasing (depth "
+             << options.aaDepth << ")...\n";
+        AdaptiveAntialiaser aa(scene, options.aaDepth, options.aaThreshold);
+        aa.render(img);
+        cout << aa.subdividedPixels() << " of " << img.size()
+             << " pixels were subdivided.\n";
+    }
+    else if (options.adaptiveSamples > 0)
+    {
+        cout << "Tracing with variance driven sampling ("
+             << options.adaptiveSamples << " samples per pixel budget)...\n";
+        SampleBuffer samples(img.width(), img.height());
+        AdaptiveSampler(scene, options.tileSize, options.adaptiveSamples,
+                        options.noiseThreshold).render(img, samples);
+        if (!options.sampleMap.empty())
+        {
+            cout << "Writing samples per pixel to " << options.sampleMap
+                 << "...\n";
+            AdaptiveSampler::writeSampleMap(samples, options.sampleMap);
+        }
+    }
+    else
+    {
+        cout << "Tracing (" << pixelOrderName(options.order)
+             << " order)...\n";
+        scene.render(img, options);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    reportRays(scene.getStats(), elapsed.count(), img.size());
+
+    if (options.denoise > 0)
+    {
+        start = chrono::steady_clock::now();
+        vector<DenoiseFeature> features;
+        scene.fillFeatures(features);
+        unsigned passes = Denoiser(options.denoise, scene.getThreadPool())
+                              .apply(img, features);
+        elapsed = chrono::steady_clock::now() - start;
+        cout << "Denoised in " << passes << " passes ("
+             << elapsed.count() << " s).\n";
+    }
+    return img;
+}
+
+void Raytracer::renderDistributed(string const &ofname,
+                                  RenderOptions const &options)
+{
+    // workers get the scene as parsed, not its file: they may run on
+    // machines where the file is not (models must be there though)
+    json job{{"scene", json::parse(sceneText)},
+             {"options", {{"order", pixelOrderName(options.order)},
+                          {"tile-size", to_string(options.tileSize)}}}};
+
+    Camera const &camera = scene.getCamera();
+    Image img(camera.width(), camera.height());
+    auto start = chrono::steady_clock::now();
+    TileCoordinator(options.coordinate, job.dump(), img.width(),
+                    img.height(), WORKER_TILE).render(img);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Rendered " << img.size() << " pixels in " << elapsed.count()
+         << " s.\n";
+
+    cout << "Writing image to " << ofname << "...\n";
+    writeImage(img, ofname, options);
+    cout << "Done.\n";
+}
+
+Image Raytracer::renderWindow(Tile const &window,
+                             RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    if (!fitsIn(window, camera.width(), camera.height()))
+        throw runtime_error("Window does not fit in the frame.");
+
+    Image img(window.width, window.height);
+    scene.render(img, options, window.x, window.y);
+    return img;
+}
+
+RenderStats const &Raytracer::getStats() const
+{
+    return scene.getStats();
+}
+
+void Raytracer::renderCrop(string const &ofname,
+                           RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    Tile const &crop = options.crop;
+    if (!fitsIn(crop, camera.width(), camera.height()))
+        throw runtime_error("Crop window does not fit in the frame.");
+
+    // check the frame before spending time on tracing
+    Image frame;
+    if (!options.composite.empty())
+    {
+        frame = Image(options.composite);
+        if (frame.width() != camera.width()
+            || frame.height() != camera.height())
+            throw runtime_error(options.composite
+                                + " does not match the frame size.");
+    }
+
+    cout << "Tracing " << crop.width << 'x' << crop.height << " window at ("
+         << crop.x << ", " << crop.y << ")...\n";
+    auto start = chrono::steady_clock::now();
+    Image img = renderWindow(crop, options);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    reportRays(scene.getStats(), elapsed.count(), img.size());
+
+    if (!options.composite.empty())
+    {
+        Image::Tile window = frame.tile(crop.x, crop.y, crop.width,
+                                        crop.height);
+        for (unsigned y = 0; y < crop.height; ++y)
+            for (unsigned x = 0; x < crop.width; ++x)
+                window(x, y) = img(x, y);
+        cout << "Writing " << options.composite << " with the window to "
+             << ofname << "...\n";
+        writeImage(frame, ofname, options);
+    }
+    else
+    {
+        cout << "Writing image to " << ofname << "...\n";
+        writeImage(img, ofname, options);
+    }
+    cout << "Done.\n";
+}
+
+void Raytracer::renderGBuffer(string const &ofname,
+                              RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    GBuffer gbuffer(camera.width(), camera.height());
+
+    auto start = chrono::steady_clock::now();
+    if (!options.gbufferIn.empty())
+    {
+        cout << "Relighting from " << options.gbufferIn << "...\n";
+        unsigned long long key;
+        gbuffer.read(options.gbufferIn, key);
+        if (key != geometryKey || gbuffer.width() != camera.width()
+            || gbuffer.height() != camera.height())
+            throw runtime_error(options.gbufferIn + " was made for other "
+                                "geometry or another camera.");
+        // a damaged file may still have the right key
+        int objects = scene.getNumObject();
+        for (unsigned y = 0; y != gbuffer.height(); ++y)
+            for (unsigned x = 0; x != gbuffer.width(); ++x)
+                if (gbuffer(x, y).object < -1
+                    || gbuffer(x, y).object >= objects)
+                    throw runtime_error(options.gbufferIn + " refers to "
+                                        "an object the scene does not "
+                                        "have.");
+    }
+    else
+    {
+        cout << "Tracing first hits...\n";
+        scene.fillGBuffer(gbuffer);
+        cout << "Writing G-buffer to " << options.gbufferOut << "...\n";
+        gbuffer.write(options.gbufferOut, geometryKey);
+    }
+
+    Image img(camera.width(), camera.height());
+    scene.shade(gbuffer, img);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    reportRays(scene.getStats(), elapsed.count(), img.size());
+
+    cout << "Writing image to " << ofname << "...\n";
+    writeImage(img, ofname, options);
+    cout << "Done.\n";
+}
+
+void Raytracer::benchmarkShading(unsigned rounds)
+{
+    Camera const &camera = scene.getCamera();
+    GBuffer gbuffer(camera.width(), camera.height());
+    scene.fillGBuffer(gbuffer);
+
+    unsigned long long hits = 0;
+    unsigned long long perKernel[SHADING_KERNELS] = {};
+    for (unsigned y = 0; y < gbuffer.height(); ++y)
+        for (unsigned x = 0; x < gbuffer.width(); ++x)
+            if (gbuffer(x, y).object >= 0)
+            {
+                ++hits;
+                ++perKernel[scene.getObject(gbuffer(x, y).object)
+                                ->material.shading];
+            }
+    cout << "Shading " << hits << " hits " << rounds << " times.\n"
+         << "Hits per kernel:";
+    for (unsigned kernel = 0; kernel != SHADING_KERNELS; ++kernel)
+        if (perKernel[kernel] != 0)
+            cout << ' ' << shadingName(kernel) << ": " << perKernel[kernel];
+    cout << ".\n";
+
+    // shadow rays would take most of the time, time the Phong terms only
+    scene.setShadows(false);
+
+    Image images[2] = {Image(camera.width(), camera.height()),
+                       Image(camera.width(), camera.height())};
+    double seconds[2];
+    for (int specialized = 0; specialized != 2; ++specialized)
+    {
+        scene.setShadingKernels(specialized);
+        auto start = chrono::steady_clock::now();
+        for (unsigned round = 0; round != rounds; ++round)
+            scene.shade(gbuffer, images[specialized]);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        seconds[specialized] = elapsed.count();
+    }
+
+    double difference = 0;
+    for (unsigned y = 0; y < camera.height(); ++y)
+        for (unsigned x = 0; x < camera.width(); ++x)
+            for (int channel = 0; channel != 3; ++channel)
+                difference = max<double>(difference,
+                                         fabs(images[0](x, y).data[channel]
+                                              - images[1](x, y).data[channel]));
+
+    double total = static_cast<double>(hits) * rounds;
+    cout << "Generic kernel:     " << total / seconds[0] << " hits/s.\n"
+         << "Material kernels:   " << total / seconds[1] << " hits/s ("
+         << seconds[0] / seconds[1] << "x).\n"
+         << "Largest difference: " << difference << ".\n";
+}
+
+void Raytracer::renderIncremental(string const &ofname,
+                                  RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    unsigned w = camera.width();
+    unsigned h = camera.height();
+
+    Raytracer previous;
+    if (!previous.readScene(options.previous))
+        throw runtime_error("Could not read " + options.previous + '.');
+    Image img(options.previousImage);
+    if (img.width() != w || img.height() != h)
+        throw runtime_error(options.previousImage
+                            + " does not match the frame size.");
+
+    // Without reflections an object only shows up in the pixels it
+    // covers and, with shadows, in the pixels whose shadow rays pass its
+    // old or new bounds: those are all that can change. Other lights,
+    // light sampling or another camera change every pixel, and so does
+    // anything in a scene with reflections, refractions or path tracing:
+    // then the whole frame is rendered.
+    bool everything = viewNode != previous.viewNode
+                      || lightNodes != previous.lightNodes
+                      || shadows != previous.shadows
+                      || lightSampling != previous.lightSampling
+                      || lightSamples != previous.lightSamples
+                      || secondaryRays || previous.secondaryRays;
+    vector<char> mask(img.size(), 0);
+    vector<pair<Point, Point>> boxes;   // of the changed objects
+    auto changed = [&](Object const &object)
+    {
+        markBounds(camera, object, mask);
+        Point lo, hi;
+        if (object.bounds(lo, hi))
+            boxes.push_back(make_pair(lo, hi));
+        else if (shadows)
+            everything = true;      // its shadow may fall anywhere
+    };
+    if (!everything)
+    {
+        size_t count = max(objectNodes.size(), previous.objectNodes.size());
+        for (size_t idx = 0; idx != count; ++idx)
+        {
+            bool inOld = idx < previous.objectNodes.size();
+            bool inNew = idx < objectNodes.size();
+            if (inOld && inNew && objectNodes[idx] == previous.objectNodes[idx])
+                continue;
+            if (inOld)
+                changed(*previous.scene.getObject(idx));
+            if (inNew)
+                changed(*scene.getObject(idx));
+        }
+    }
+    if (!everything && shadows && !boxes.empty())
+        markShadows(scene, boxes, mask);
+
+    cout << "Re-tracing changes since " << options.previous << "...\n";
+    auto start = chrono::steady_clock::now();
+    unsigned long long retraced = 0;
+    if (everything)
+    {
+        scene.render(img, options);
+        retraced = img.size();
+    }
+    RayTree tree;
+    for (unsigned y = 0; y < h && !everything; ++y)
+    {
+        for (unsigned x = 0; x < w; ++x)
+        {
+            if (!mask[y * w + x])
+                continue;
+            Color col = scene.tracePixel(x + 0.5, y + 0.5, tree);
+            col.clamp();
+            img(x, y) = col;
+            ++retraced;
+        }
+    }
+    scene.addTree(tree);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Re-traced " << retraced << " of " << img.size() << " pixels.\n";
+    reportRays(scene.getStats(), elapsed.count(), img.size());
+
+    // the pixels kept from old.png are 8 bit values already, tone mapping
+    // them again would change them
+    cout << "Writing image to " << ofname << "...\n";
+    img.write(ofname);
+    cout << "Done.\n";
+}
+
+void Raytracer::renderCheckpointed(string const &ofname,
+                                   RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    Image img(camera.width(), camera.height());
+
+    // full width bands, so every band is traced by all threads
+    vector<Tile> bands;
+    for (unsigned y = 0; y < img.height(); y += CHECKPOINT_ROWS)
+        bands.push_back(Tile{0, y, img.width(),
+                             min(CHECKPOINT_ROWS, img.height() - y)});
+
+    Checkpoint checkpoint(options.checkpoint,
+                          checkpointKey(sceneText, options),
+                          options.checkpointInterval);
+    vector<char> done(bands.size(), 0);
+    if (options.resume && checkpoint.load(bands, done, img))
+        cout << "Resuming from " << options.checkpoint << ": "
+             << count(done.begin(), done.end(), 1) << " of "
+             << bands.size() << " bands are done.\n";
+
+    cout << "Tracing (" << pixelOrderName(options.order)
+         << " order), saving progress to " << options.checkpoint << "...\n";
+    auto start = chrono::steady_clock::now();
+    for (size_t idx = 0; idx != bands.size(); ++idx)
+    {
+        if (done[idx])
+            continue;
+
+        Tile const &band = bands[idx];
+        Image pixels(band.width, band.height);
+        scene.render(pixels, options, band.x, band.y);
+        Image::Tile view = img.tile(band.x, band.y, band.width, band.height);
+        for (unsigned y = 0; y != band.height; ++y)
+            for (unsigned x = 0; x != band.width; ++x)
+                view(x, y) = pixels(x, y);
+        done[idx] = 1;
+
+        if (checkpoint.due())
+            checkpoint.save(bands, done, img);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    reportRays(scene.getStats(), elapsed.count(), img.size());
+
+    cout << "Writing image to " << ofname << "...\n";
+    writeImage(img, ofname, options);
+    checkpoint.remove();
+    cout << "Done.\n";
+}
+
+void Raytracer::renderStrips(string const &ofname,
+                             RenderOptions const &options)
+{
+    Camera const &camera = scene.getCamera();
+    unsigned width = camera.width();
+    unsigned height = camera.height();
+    unsigned rows = options.stripHeight > 0 ? options.stripHeight
+                                            : STRIP_HEIGHT;
+
+    cout << "Tracing " << width << 'x' << height << " in strips of "
+         << rows << " rows to " << ofname << "...\n";
+
+    auto start = chrono::steady_clock::now();
+    PngWriter writer(ofname, width, height, options.toneMap,
+                     options.pngLevel);
+    Image strip(width, min(rows, height));
+    for (unsigned y = 0; y < height; y += rows)
+    {
+        // the last strip may be lower
+        if (height - y < strip.height())
+            strip = Image(width, height - y);
+        scene.render(strip, options, 0, y);
+        writer.writeRows(strip);
+    }
+    writer.close();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    reportRays(scene.getStats(), elapsed.count(),
+               static_cast<unsigned long long>(width) * height);
+    cout << "Done.\n";
+}
+
+void Raytracer::writeImage(Image const &img, string const &ofname,
+                           RenderOptions const &options)
+{
+    auto start = chrono::steady_clock::now();
+    img.write(ofname, options.toneMap,
+              PngEncoder(options.pngLevel, scene.getThreadPool()));
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Encoded in " << elapsed.count() << " s.\n";
+}
@@ -1,31 +1,117 @@
 #ifndef RAYTRACER_H_
 #define RAYTRACER_H_
 
+#include "renderoptions.h"
 #include "scene.h"
 
+#include <iosfwd>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 // Forward declerations
+class Camera;
+class Image;
 class Light;
 class Material;
+class ModelCache;
+class Texture;
+class ThreadPool;
 
 #include "json/json_fwd.h"
 
 class Raytracer
 {
     Scene scene;
+    unsigned long long geometryKey; // hash of camera and object geometry
+
+    // JSON text of the parsed scene parts, to compare scene versions
+    std::string viewNode;                   // "Camera" or "Eye"
+    std::string lightNodes;
+    std::vector<std::string> objectNodes;   // one per scene object
+    std::string sceneText;                  // all of it, for workers
+    bool secondaryRays;     // has reflecting or refracting materials,
+                            // or is path traced
+    bool shadows;           // traces shadow rays
+    LightSampling lightSampling;    // and lightSamples, as parsed
+    unsigned lightSamples;
+
+    ModelCache *models;     // where meshes come from, nullptr: from disk
+
+    // color maps of the materials, by file name and format
+    std::map<std::string, std::shared_ptr<Texture>> textures;
 
     public:
 
+        Raytracer();
+
+        // load OBJ models through cache (call before readScene)
+        void useModelCache(ModelCache &cache);
+
+        // trace tiles on the threads of pool
+        void useThreadPool(ThreadPool &pool);
+
         bool readScene(std::string const &ifname);
-        void renderToFile(std::string const &ofname);
+        bool readScene(std::istream &in);       // the JSON text of a scene
+        void renderToFile(std::string const &ofname,
+                          RenderOptions const &options);
+
+        // render the full frame in memory with the sampling mode of the
+        // options (ofname is only used for progressive flushes)
+        Image renderImage(std::string const &ofname,
+                          RenderOptions const &options);
+
+        // plain render of a part of the frame only, to its own image
+        Image renderWindow(Tile const &window, RenderOptions const &options);
+
+        RenderStats const &getStats() const;
+
+        // times shading of the first hits of all pixels (without
+        // shadows) with the generic and the per material Phong kernels
+        // and prints their throughput and largest difference
+        void benchmarkShading(unsigned rounds);
 
     private:
 
+        // render options.crop only, to its own image or composited
+        void renderCrop(std::string const &ofname,
+                        RenderOptions const &options);
+
+        // render through a G-buffer: save the first hits, or shade
+        // stored ones again
+        void renderGBuffer(std::string const &ofname,
+                           RenderOptions const &options);
+
+        // re-trace only the pixels that may differ from options.previous
+        void renderIncremental(std::string const &ofname,
+                               RenderOptions const &options);
+
+        // hand out the tiles of the frame to worker processes
+        void renderDistributed(std::string const &ofname,
+                               RenderOptions const &options);
+
+        // plain render in bands, saving the finished ones to a checkpoint
+        void renderCheckpointed(std::string const &ofname,
+                                RenderOptions const &options);
+
+        // render in horizontal strips straight into a streaming encoder
+        void renderStrips(std::string const &ofname,
+                          RenderOptions const &options);
+
+        // write img with the tone map and PNG level of options (PNGs are
+        // encoded on the render threads), reporting the time it took
+        void writeImage(Image const &img, std::string const &ofname,
+                        RenderOptions const &options);
+
         bool parseObjectNode(nlohmann::json const &node);
 
+        Camera parseCameraNode(nlohmann::json const &node) const;
         Light parseLightNode(nlohmann::json const &node) const;
-        Material parseMaterialNode(nlohmann::json const &node) const;
+        Material parseMaterialNode(nlohmann::json const &node);
+        void parseRecursion(nlohmann::json const &node);
+        void parseIntegrator(nlohmann::json const &node);
+        void parseLightSampling(nlohmann::json const &node);
 };
 
 #endif
@@ -0,0 +1,186 @@
+#include "renderoptions.h"
+
+#include "adaptivesampler.h"
+
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // digits only: stoul would also take "-1" (and wrap it around)
+    unsigned parseCount(string const &value)
+    {
+        if (value.empty() || !isdigit(static_cast<unsigned char>(value[0])))
+            throw invalid_argument("expected a number: " + value);
+        size_t end;
+        unsigned long result = stoul(value, &end);
+        if (end != value.size() || result > numeric_limits<unsigned>::max())
+            throw invalid_argument("expected a number: " + value);
+        return result;
+    }
+
+    unsigned parseUnsigned(string const &value)
+    {
+        unsigned result = parseCount(value);
+        if (result == 0)
+            throw invalid_argument("expected a positive number: " + value);
+        return result;
+    }
+
+    double parseSeconds(string const &value)
+    {
+        size_t end;
+        double result = stod(value, &end);
+        if (end != value.size() || !(result > 0))
+            throw invalid_argument("expected a positive time: " + value);
+        return result;
+    }
+
+    double parseFraction(string const &value)
+    {
+        size_t end;
+        double result = stod(value, &end);
+        if (end != value.size() || !(result >= 0 && result <= 1))
+            throw invalid_argument("expected a value in [0, 1]: " + value);
+        return result;
+    }
+
+    // "x,y,w,h" -> Tile
+    Tile parseCrop(string const &value)
+    {
+        unsigned numbers[4];
+        size_t pos = 0;
+        for (unsigned idx = 0; idx != 4; ++idx)
+        {
+            size_t end = value.find(',', pos);
+            if ((end == string::npos) != (idx == 3))
+                throw invalid_argument("expected x,y,w,h: " + value);
+            string number = value.substr(pos, end - pos);
+            numbers[idx] = idx < 2 ? parseCount(number) : parseUnsigned(number);
+            pos = end + 1;
+        }
+        return Tile{numbers[0], numbers[1], numbers[2], numbers[3]};
+    }
+}
+
+void parseRenderOption(string const &option, string const &value,
+                       RenderOptions &options)
+{
+    if (option == "--order")
+    {
+        if (!parsePixelOrder(value, options.order))
+            throw invalid_argument("unknown pixel order: " + value);
+    }
+    else if (option == "--tile-size")
+        options.tileSize = parseUnsigned(value);
+    else if (option == "--strip-height")
+        options.stripHeight = parseUnsigned(value);
+    else if (option == "--crop")
+        options.crop = parseCrop(value);
+    else if (option == "--composite")
+        options.composite = value;
+    else if (option == "--gbuffer-out")
+        options.gbufferOut = value;
+    else if (option == "--gbuffer-in")
+        options.gbufferIn = value;
+    else if (option == "--previous")
+        options.previous = value;
+    else if (option == "--previous-image")
+        options.previousImage = value;
+    else if (option == "--sequence")
+        options.sequence = value;
+    else if (option == "--batch")
+        options.batch = value;
+    else if (option == "--cache-limit")
+        options.cacheLimit = parseUnsigned(value) * size_t(1 << 20);
+    else if (option == "--checkpoint")
+        options.checkpoint = value;
+    else if (option == "--resume")
+    {
+        options.checkpoint = value;
+        options.resume = true;
+    }
+    else if (option == "--checkpoint-interval")
+        options.checkpointInterval = parseSeconds(value);
+    else if (option == "--coordinate")
+        options.coordinate = value;
+    else if (option == "--worker")
+        options.worker = value;
+    else if (option == "--serve")
+        options.serve = value;
+    else if (option == "--max-jobs")
+        options.maxJobs = parseUnsigned(value);
+    else if (option == "--threads")
+        options.threads = parseCount(value);
+    else if (option == "--time-budget")
+        options.timeBudget = parseSeconds(value);
+    else if (option == "--flush-interval")
+        options.flushInterval = parseSeconds(value);
+    else if (option == "--spp")
+        options.samples = parseUnsigned(value);
+    else if (option == "--aa-depth")
+        options.aaDepth = parseUnsigned(value);
+    else if (option == "--aa-threshold")
+        options.aaThreshold = parseFraction(value);
+    else if (option == "--adaptive-spp")
+    {
+        // every pixel gets the minimum first, a smaller budget would be
+        // overspent
+        options.adaptiveSamples = parseUnsigned(value);
+        if (options.adaptiveSamples < AdaptiveSampler::MIN_SAMPLES)
+            throw invalid_argument("--adaptive-spp must be at least "
+                                   + to_string(AdaptiveSampler::MIN_SAMPLES));
+    }
+    else if (option == "--noise-threshold")
+        options.noiseThreshold = parseFraction(value);
+    else if (option == "--sample-map")
+        options.sampleMap = value;
+    else if (option == "--shading")
+    {
+        if (value != "scalar" && value != "batch")
+            throw invalid_argument("unknown shading: " + value);
+        options.batchShading = value == "batch";
+    }
+    else if (option == "--tonemap")
+    {
+        if (!parseToneOperator(value, options.toneMap.op))
+            throw invalid_argument("unknown tone mapping: " + value);
+    }
+    else if (option == "--exposure")
+    {
+        size_t end;
+        options.toneMap.exposure = stof(value, &end);
+        if (end != value.size() || !isfinite(options.toneMap.exposure))
+            throw invalid_argument("expected a number of stops: " + value);
+    }
+    else if (option == "--encoding")
+    {
+        if (value != "linear" && value != "srgb")
+            throw invalid_argument("unknown encoding: " + value);
+        options.toneMap.srgb = value == "srgb";
+    }
+    else if (option == "--png-level")
+    {
+        if (value.size() != 1 || value[0] < '0' || value[0] > '9')
+            throw invalid_argument("expected a level 0...9: " + value);
+        options.pngLevel = value[0] - '0';
+    }
+    else if (option == "--denoise")
+        options.denoise = parseUnsigned(value);
+    else if (option == "--bench-shading")
+        options.benchShading = parseUnsigned(value);
+    else
+        throw invalid_argument("unknown option: " + option);
+}
+
+void checkRenderOptions(RenderOptions const &options)
+{
+    if (!options.composite.empty() && options.crop.width == 0)
+        throw invalid_argument("--composite needs --crop");
+    if (options.previous.empty() != options.previousImage.empty())
+        throw invalid_argument("--previous and --previous-image go together");
+}
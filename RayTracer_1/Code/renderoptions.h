@@ -0,0 +1,83 @@
+#ifndef RENDEROPTIONS_H_
+#define RENDEROPTIONS_H_
+
+#include "pixelorder.h"
+#include "pngencoder.h"
+#include "tonemap.h"
+
+#include <cstddef>
+#include <string>
+
+// Settings of a render that are not part of the scene description,
+// set from the command line (see main.cpp)
+struct RenderOptions
+{
+    PixelOrder order = PixelOrder::SCANLINE;    // pixel traversal order
+    unsigned tileSize = 16;                     // tile edge in pixels
+    unsigned stripHeight = 0;   // rows per streamed strip, 0: only when huge
+
+    // region of interest, a width of 0 renders the whole frame
+    Tile crop = Tile{0, 0, 0, 0};
+    std::string composite;      // full frame PNG to paste the crop into
+
+    // relighting: save first hits to / shade them again from a G-buffer
+    std::string gbufferOut;
+    std::string gbufferIn;
+
+    // incremental: scene and image of the previous version of the scene
+    std::string previous;
+    std::string previousImage;
+
+    // sequence: directory or glob pattern of scenes to render in one go
+    std::string sequence;
+    std::string batch;              // manifest of scene / output pairs
+    size_t cacheLimit = 0;          // model cache bytes, 0: no limit
+
+    unsigned threads = 0;           // tile worker threads, 0: one per core
+    bool batchShading = false;      // shade the hits of a tile together
+    unsigned denoise = 0;           // a-trous denoiser passes, 0: none
+    ToneMap toneMap;                // float colors -> 8 bit PNG values
+    int pngLevel = PngEncoder::DEFAULT_LEVEL;   // zlib level, 0...9
+
+    // checkpoints: file to save progress to, pick up saved progress first
+    std::string checkpoint;
+    bool resume = false;
+    double checkpointInterval = 60.0;   // seconds between saves
+
+    // distributed: address to hand out tiles on / to get them from
+    std::string coordinate;
+    std::string worker;
+
+    // daemon: Unix socket to serve render jobs on, jobs rendered at once
+    std::string serve;
+    unsigned maxJobs = 2;
+
+    // progressive mode, enabled by a time budget > 0 (seconds)
+    double timeBudget = 0.0;
+    double flushInterval = 1.0;     // seconds between output file updates
+    unsigned samples = 0;           // samples per pixel cap, 0: no cap
+
+    // adaptive anti-aliasing, enabled by a maximum subdivision depth > 0
+    unsigned aaDepth = 0;
+    double aaThreshold = 0.1;       // max color difference between corners
+
+    // variance driven sampling, enabled by an average sample budget > 0
+    unsigned adaptiveSamples = 0;   // per pixel, on average
+    double noiseThreshold = 0.01;   // 95% confidence interval to stop at
+    std::string sampleMap;          // samples per pixel image, if not empty
+
+    // benchmark: shade the first hits this many times with the generic
+    // and the per material shading kernels, instead of rendering
+    unsigned benchShading = 0;
+};
+
+// Handles "--option value" (as on the command line), throws
+// invalid_argument on unknown options or bad values
+void parseRenderOption(std::string const &option, std::string const &value,
+                       RenderOptions &options);
+
+// Throws invalid_argument if options that need each other are not given
+// together
+void checkRenderOptions(RenderOptions const &options);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef RENDERSTATS_H_
+#define RENDERSTATS_H_
+
+#include <atomic>
+
+// Largest depth of reflected / refracted rays a scene may ask for
+unsigned const MAX_TRACE_DEPTH = 16;
+
+// Rays of a tile (or another batch of pixels): primary rays, their
+// reflected and refracted rays (path bounces for the path integrator)
+// and shadow rays, counted locally and added to RenderStats once
+struct RayTree
+{
+    unsigned primary = 0;   // rays from the eye
+    unsigned rays[MAX_TRACE_DEPTH] = {};    // per depth, [0]: depth 1
+    unsigned shadow = 0;    // shadow rays towards the lights
+    unsigned blocked = 0;   // ... that hit an object
+    unsigned cached = 0;    // ... that hit the light's last occluder
+    unsigned areaTests = 0; // area light visibility estimates
+    unsigned penumbra = 0;  // ... that needed all strata
+    unsigned paths = 0;     // path integrator: samples (paths) traced
+    unsigned roulette = 0;  // paths ended by Russian roulette
+    unsigned cutoff = 0;    // ... by the throughput cutoff
+    unsigned maxDepth = 0;  // ... by the maximum depth
+};
+
+// Counters gathered while rendering, reported after a render. Tiles are
+// rendered in parallel, so the counters are atomic: add to them in bulk
+// (per tile), not per ray.
+struct RenderStats
+{
+    std::atomic<unsigned long long> primaryRays{0};     // rays from the eye
+
+    // secondary rays per depth and why their paths ended, see RayTree
+    std::atomic<unsigned long long> secondaryRays[MAX_TRACE_DEPTH] = {};
+    std::atomic<unsigned long long> rouletteEnds{0};
+    std::atomic<unsigned long long> cutoffEnds{0};
+    std::atomic<unsigned long long> maxDepthEnds{0};
+
+    // shadow rays, those blocked and those blocked by the object that
+    // blocked the previous shadow ray towards the light (cache hits)
+    std::atomic<unsigned long long> shadowRays{0};
+    std::atomic<unsigned long long> blockedShadowRays{0};
+    std::atomic<unsigned long long> occluderCacheHits{0};
+
+    // area light visibility estimates, and those in a penumbra (where
+    // the first shadow rays disagreed and all strata were traced)
+    std::atomic<unsigned long long> areaLightTests{0};
+    std::atomic<unsigned long long> penumbraTests{0};
+    std::atomic<unsigned long long> pathSamples{0};     // path integrator
+};
+
+#endif
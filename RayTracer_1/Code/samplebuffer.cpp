@@ -0,0 +1,90 @@
+#include "samplebuffer.h"
+
+#include "image.h"
+
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <ostream>
+
+using namespace std;
+
+SampleBuffer::SampleBuffer(unsigned width, unsigned height)
+:
+    d_pixels(width * height, Accum{{0, 0, 0}, {0, 0, 0}, 0}),
+    d_width(width),
+    d_height(height)
+{}
+
+void SampleBuffer::add(unsigned x, unsigned y, Color const &sample)
+{
+    Accum &pixel = d_pixels[index(x, y)];
+    ++pixel.count;
+    for (unsigned idx = 0; idx != 3; ++idx)
+    {
+        float value = sample.data[idx];
+        float delta = value - pixel.mean[idx];
+        pixel.mean[idx] += delta / pixel.count;
+        pixel.m2[idx] += delta * (value - pixel.mean[idx]);
+    }
+}
+
+Color SampleBuffer::mean(unsigned x, unsigned y) const
+{
+    Accum const &pixel = d_pixels[index(x, y)];
+    return Color(pixel.mean[0], pixel.mean[1], pixel.mean[2]);
+}
+
+Color SampleBuffer::variance(unsigned x, unsigned y) const
+{
+    Accum const &pixel = d_pixels[index(x, y)];
+    if (pixel.count < 2)
+        return Color(0.0, 0.0, 0.0);
+    return Color(pixel.m2[0], pixel.m2[1], pixel.m2[2]) / (pixel.count - 1);
+}
+
+double SampleBuffer::confidence(unsigned x, unsigned y) const
+{
+    unsigned n = count(x, y);
+    if (n < 2)
+        return numeric_limits<double>::infinity();
+
+    Color var = variance(x, y);
+    double worst = fmax(var.r, fmax(var.g, var.b));
+    return 1.96 * sqrt(worst / n);
+}
+
+unsigned SampleBuffer::count(unsigned x, unsigned y) const
+{
+    return d_pixels[index(x, y)].count;
+}
+
+unsigned SampleBuffer::width() const
+{
+    return d_width;
+}
+
+unsigned SampleBuffer::height() const
+{
+    return d_height;
+}
+
+void SampleBuffer::resolve(Image &img) const
+{
+    for (unsigned y = 0; y < d_height; ++y)
+        for (unsigned x = 0; x < d_width; ++x)
+            if (count(x, y) != 0)
+                img(x, y) = mean(x, y);
+}
+
+void SampleBuffer::write(ostream &out) const
+{
+    out.write(reinterpret_cast<char const *>(d_pixels.data()),
+              d_pixels.size() * sizeof(Accum));
+}
+
+void SampleBuffer::read(istream &in)
+{
+    in.read(reinterpret_cast<char *>(d_pixels.data()),
+            d_pixels.size() * sizeof(Accum));
+}
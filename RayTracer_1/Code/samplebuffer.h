@@ -0,0 +1,59 @@
+#ifndef SAMPLEBUFFER_H_
+#define SAMPLEBUFFER_H_
+
+#include "triple.h"
+
+#include <iosfwd>
+#include <vector>
+
+class Image;
+
+// Per pixel accumulation of samples, kept in floats next to an Image
+// while rendering with more than one sample per pixel. The running mean
+// and variance are updated with Welford's algorithm, which stays
+// accurate in single precision.
+class SampleBuffer
+{
+    struct Accum
+    {
+        float mean[3];
+        float m2[3];        // sum of squared differences from the mean
+        unsigned count;
+    };
+
+    std::vector<Accum> d_pixels;
+    unsigned d_width;
+    unsigned d_height;
+
+    public:
+        SampleBuffer(unsigned width, unsigned height);
+
+        void add(unsigned x, unsigned y, Color const &sample);
+
+        Color mean(unsigned x, unsigned y) const;   // black without samples
+        Color variance(unsigned x, unsigned y) const;   // of the samples
+        unsigned count(unsigned x, unsigned y) const;
+
+        // half width of the 95% confidence interval of the mean (worst
+        // channel), infinite with less than two samples
+        double confidence(unsigned x, unsigned y) const;
+
+        unsigned width() const;
+        unsigned height() const;
+
+        // write the mean of every sampled pixel to img
+        void resolve(Image &img) const;
+
+        // the raw accumulators (native byte order), read expects a buffer
+        // of the same size
+        void write(std::ostream &out) const;
+        void read(std::istream &in);
+
+    private:
+        inline unsigned index(unsigned x, unsigned y) const
+        {
+            return y * d_width + x;
+        }
+};
+
+#endif
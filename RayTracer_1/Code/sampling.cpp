@@ -0,0 +1,75 @@
+#include "sampling.h"
+
+#include "ray.h"
+
+#include <cstring>
+
+double radicalInverse(unsigned base, unsigned long index)
+{
+    double inverse = 1.0 / base;
+    double factor = inverse;
+    double result = 0.0;
+    while (index != 0)
+    {
+        result += (index % base) * factor;
+        index /= base;
+        factor *= inverse;
+    }
+    return result;
+}
+
+void pixelSampleOffset(unsigned long index, double &dx, double &dy)
+{
+    if (index == 0)
+    {
+        dx = 0.5;
+        dy = 0.5;
+        return;
+    }
+    dx = radicalInverse(2, index);
+    dy = radicalInverse(3, index);
+}
+
+uint64_t hashRay(Ray const &ray)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    double const values[6] = {ray.O.x, ray.O.y, ray.O.z,
+                              ray.D.x, ray.D.y, ray.D.z};
+    for (double value : values)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof bits);
+        hash = (hash ^ bits) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+namespace
+{
+    uint64_t const PCG_MULTIPLIER = 6364136223846793005ULL;
+    uint64_t const PCG_INCREMENT = 1442695040888963407ULL;
+}
+
+Random::Random(uint64_t seed)
+:
+    d_state(0)
+{
+    nextInt();
+    d_state += seed;
+    nextInt();
+}
+
+uint32_t Random::nextInt()
+{
+    uint64_t old = d_state;
+    d_state = old * PCG_MULTIPLIER + PCG_INCREMENT;
+    uint32_t shifted = ((old >> 18) ^ old) >> 27;
+    uint32_t rot = old >> 59;
+    return (shifted >> rot) | (shifted << ((32 - rot) & 31));
+}
+
+double Random::next()
+{
+    return nextInt() * (1.0 / 4294967296.0);
+}
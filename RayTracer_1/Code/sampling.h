@@ -0,0 +1,35 @@
+#ifndef SAMPLING_H_
+#define SAMPLING_H_
+
+#include <cstdint>
+
+class Ray;
+
+// Low discrepancy sample positions and random numbers, deterministic so
+// renders can be reproduced exactly.
+
+// Radical inverse of index in the given (prime) base, in [0, 1)
+double radicalInverse(unsigned base, unsigned long index);
+
+// Offset in [0, 1)^2 inside a pixel of the index-th sample, sample 0 is
+// the pixel centre, the others follow the Halton (2, 3) sequence.
+void pixelSampleOffset(unsigned long index, double &dx, double &dy);
+
+// Hash of the origin and direction of a ray: a seed that only depends on
+// the ray, so random decisions do not depend on the thread count or the
+// order in which pixels are traced
+uint64_t hashRay(Ray const &ray);
+
+// Small pseudo random number generator (PCG32) for Monte Carlo sampling
+class Random
+{
+    uint64_t d_state;
+
+    public:
+        explicit Random(uint64_t seed);
+
+        uint32_t nextInt();
+        double next();          // uniform in [0, 1)
+};
+
+#endif
@@ -1,35 +1,160 @@
 #include "scene.h"
 
+#include "denoiser.h"
+#include "gbuffer.h"
 #include "hit.h"
 #include "image.h"
 #include "material.h"
 #include "ray.h"
+#include "sampling.h"
+#include "simdmath.h"
+#include "texture.h"
+#include "threadpool.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 
 using namespace std;
 
-Color Scene::trace(Ray const &ray) {
+namespace {
+    // secondary rays start this far from the surface, so they do not hit
+    // it again through rounding errors
+    double const RAY_OFFSET = 1e-6;
+
+    // texture footprints grow by 1 / cosine on tilted surfaces, up to 10
+    // times (beyond that the blur would hide more than the aliasing)
+    double const MIN_FOOTPRINT_COSINE = 0.1;
+
+    // Random number in [0, 1) that only depends on the ray, so Russian
+    // roulette gives the same image for any thread count or tile order
+    double rouletteSample(Ray const &ray) {
+        return (hashRay(ray) >> 11) * (1.0 / 9007199254740992.0);   // 53 bits
+    }
+
+    // unit vector at angle acos(cosTheta) from axis, rotated phi around it
+    Vector aroundAxis(Vector const &axis, double cosTheta, double phi) {
+        Vector helper = fabs(axis.x) > 0.5 ? Vector(0, 1, 0) : Vector(1, 0, 0);
+        Vector u = axis.cross(helper).normalized();
+        Vector v = axis.cross(u);
+        double sinTheta = sqrt(max(0.0, 1 - cosTheta * cosTheta));
+        return cosTheta * axis + sinTheta * (cos(phi) * u + sin(phi) * v);
+    }
+
+    // x^n by repeated squaring
+    double powInt(double x, unsigned n) {
+        double result = 1;
+        while (n != 0) {
+            if (n & 1)
+                result *= x;
+            x *= x;
+            n >>= 1;
+        }
+        return result;
+    }
+
+    // Light direction L's cosine with N and (if the features have a
+    // specular term) raw Phong highlight, as the Phong kernel with those
+    // features computes them. Batch shading takes these to decide on
+    // shadow rays, so it traces the same ones as the scalar kernels.
+    inline void phongTerms(unsigned features, Material const &material,
+                           Vector const &N, Vector const &V,
+                           Vector const &L, double &dot1,
+                           double &highlight) {
+        dot1 = max(L.dot(N), 0.0);
+        highlight = 0;
+        if (features & SHADE_SPECULAR) {
+            Vector R = (2 * N.dot(L) * N - L).normalized();
+            double dot2 = max(R.dot(V), 0.0);
+            highlight = features & SHADE_INTEGER_EXPONENT
+                        ? powInt(dot2, static_cast<unsigned>(material.n))
+                        : pow(dot2, material.n);
+        }
+    }
+
+    double maxComponent(Color const &color) {
+        return max(color.r, max(color.g, color.b));
+    }
+
+    // Per light, the object that last blocked a shadow ray towards it.
+    // Neighbouring shadow rays are mostly blocked by the same object, so
+    // it is tested before all others. Tiles render in parallel, so every
+    // thread keeps its own; it is reset when the thread moves on to
+    // another scene. The index is only a hint, a stale one costs a test.
+    struct OccluderCache {
+        Scene const *scene = nullptr;
+        vector<int> last;           // per light, -1: none yet
+    };
+    thread_local OccluderCache occluderCache;
+
+    // refracted direction of D through a surface with normal N (facing
+    // D's origin) and ratio eta of the indices, false on total internal
+    // reflection
+    bool refract(Vector const &D, Vector const &N, double eta, Vector &T) {
+        double cosi = -D.dot(N);
+        double k = 1 - eta * eta * (1 - cosi * cosi);
+        if (k < 0)
+            return false;
+        T = (eta * D + (eta * cosi - sqrt(k)) * N).normalized();
+        return true;
+    }
+}
+
+Color Scene::trace(Ray const &ray, RayTree &tree, int *objectId) {
+    SurfacePoint surface;
+    bool found = intersect(ray, surface);
+
+    if (objectId)
+        *objectId = surface.object;
+
+    // No hit? Return background color.
+    if (!found)
+        return Color(0.0, 0.0, 0.0);
+
+    return shade(surface, 0, tree);
+}
+
+bool Scene::intersect(Ray const &ray, SurfacePoint &surface) {
     // Find hit object and distance
     Hit min_hit(numeric_limits<double>::infinity(), Vector());
-    ObjectPtr obj = nullptr;
+    int obj_idx = -1;
     for (unsigned idx = 0; idx != objects.size(); ++idx) {
         Hit hit(objects[idx]->intersect(ray));
         if (hit.t < min_hit.t) {
             min_hit = hit;
-            obj = objects[idx];
+            obj_idx = idx;
         }
     }
 
-    // No hit? Return background color.
-    if (!obj)
-        return Color(0.0, 0.0, 0.0);
+    surface.object = obj_idx;
+    if (obj_idx < 0)
+        return false;
+
+    surface.position = ray.at(min_hit.t);       // the hit point
+    surface.N = min_hit.N;                      // the normal at hit point
+    surface.V = -ray.D;                         // the view vector
+    surface.inside = surface.N.dot(surface.V) < 0;
+    if (surface.inside) { surface.N *= -1; }
 
-    Material material = obj->material;          // the hit objects material
-    Point hit = ray.at(min_hit.t);              // the hit point
-    Vector N = min_hit.N;                       // the normal at hit point
-    Vector V = -ray.D;                          // the view vector
+    // a pixel seen from the ray origin, widened on tilted surfaces
+    double cosine = max(surface.N.dot(surface.V), MIN_FOOTPRINT_COSINE);
+    surface.u = min_hit.u;
+    surface.v = min_hit.v;
+    surface.footprint = min_hit.uvScale * min_hit.t * pixelSpread / cosine;
+    return true;
+}
+
+Color Scene::shade(SurfacePoint const &surface, unsigned sample,
+                   RayTree &tree) {
+    return integrator == Integrator::PATH ? tracePath(surface, sample, tree)
+                                          : shade(surface, 0, 1.0, tree);
+}
+
+Color Scene::shade(SurfacePoint const &surface, unsigned depth,
+                   double throughput, RayTree &tree) {
+    Material material = objects[surface.object]->material;
+    material.color = surfaceColor(surface, material);
     /****************************************************
     * This is where you should insert the color
     * calculation (Phong model).
@@ -48,37 +173,652 @@ Color Scene::trace(Ray const &ray) {
     *        pow(a,b)           a to the power of b
     ****************************************************/
 
-    Color color = material.color;               // placeholder
-    if (N.dot(V) < 0) { N *= -1; }
-    traceColor(color, material, N, V, hit);
+    Color color = material.color;
+    shadeLights(color, material, surface, tree);
+    if (material.traces())
+        color += traceSecondary(surface, material, depth, throughput, tree);
+    return color;
+}
+
+Color Scene::surfaceColor(SurfacePoint const &surface,
+                          Material const &material) const {
+    if (!material.texture)
+        return material.color;
+    Texture const &texture = *material.texture;
+    return material.color * texture.sample(surface.u, surface.v,
+                                           texture.lod(surface.footprint));
+}
 
+Color Scene::traceSecondary(SurfacePoint const &surface,
+                            Material const &material, unsigned depth,
+                            double throughput, RayTree &tree) {
+    Vector D = -surface.V;
+    Vector const &N = surface.N;
+    double kr = material.kr;
+    double kt = material.kt;
+
+    Vector T;
+    double eta = surface.inside ? material.ior : 1 / material.ior;
+    if (kt > 0 && !refract(D, N, eta, T)) {
+        kr += kt;       // total internal reflection
+        kt = 0;
+    }
 
+    Color color(0.0, 0.0, 0.0);
+    if (kr > 0) {
+        Ray reflected(surface.position + RAY_OFFSET * N,
+                      D - 2 * D.dot(N) * N);
+        color += kr * traceBounce(reflected, depth + 1, throughput * kr, tree);
+    }
+    if (kt > 0) {
+        Ray refracted(surface.position - RAY_OFFSET * N, T);
+        color += kt * traceBounce(refracted, depth + 1, throughput * kt, tree);
+    }
     return color;
 }
 
+Color Scene::traceBounce(Ray const &ray, unsigned depth, double throughput,
+                         RayTree &tree) {
+    Color black(0.0, 0.0, 0.0);
+    if (depth > maxDepth) {
+        ++tree.maxDepth;
+        return black;
+    }
+    if (throughput < minThroughput) {
+        ++tree.cutoff;
+        return black;
+    }
+
+    // Russian roulette: continue with probability survive, weighting the
+    // survivors by 1 / survive keeps the expected color the same
+    double weight = 1.0;
+    if (depth >= rouletteDepth) {
+        double survive = min(1.0, throughput);
+        if (rouletteSample(ray) >= survive) {
+            ++tree.roulette;
+            return black;
+        }
+        weight = 1 / survive;
+        throughput *= weight;
+    }
+
+    ++tree.rays[depth - 1];
+    SurfacePoint surface;
+    if (!intersect(ray, surface))
+        return black;
+    return weight * shade(surface, depth, throughput, tree);
+}
+
+void Scene::addTree(RayTree const &tree) {
+    stats.primaryRays += tree.primary;
+    for (unsigned depth = 0; depth != maxDepth; ++depth)
+        if (tree.rays[depth] != 0)
+            stats.secondaryRays[depth] += tree.rays[depth];
+    stats.rouletteEnds += tree.roulette;
+    stats.cutoffEnds += tree.cutoff;
+    stats.maxDepthEnds += tree.maxDepth;
+    stats.shadowRays += tree.shadow;
+    stats.blockedShadowRays += tree.blocked;
+    stats.occluderCacheHits += tree.cached;
+    stats.areaLightTests += tree.areaTests;
+    stats.penumbraTests += tree.penumbra;
+    stats.pathSamples += tree.paths;
+}
+
+// --- Path tracing ------------------------------------------------------------
+
+Color Scene::tracePath(SurfacePoint const &start, unsigned sample,
+                       RayTree &tree) {
+    // seeded by the primary hit, so the image does not depend on threads
+    Random random(hashRay(Ray(start.position, start.V))
+                  + sample * 0x9E3779B97F4A7C15ULL);
+    ++tree.paths;
+
+    Color color(0.0, 0.0, 0.0);
+    Color throughput(1.0, 1.0, 1.0);
+    SurfacePoint surface = start;
+    for (unsigned depth = 1; ; ++depth) {
+        Material material = objects[surface.object]->material;
+        material.color = surfaceColor(surface, material);
+
+        // next-event estimation: the lights are only found by sampling
+        // them directly, bounced rays never hit a (point) light
+        color += throughput * directLight(surface, material, random, tree);
+
+        Vector dir;
+        Color weight;
+        if (!scatter(surface, material, random, dir, weight))
+            break;
+        if (depth > maxDepth) {
+            ++tree.maxDepth;
+            break;
+        }
+        throughput = throughput * weight;
+
+        // Russian roulette, survivors are weighted by 1 / survive
+        if (depth >= rouletteDepth) {
+            double survive = min(1.0, maxComponent(throughput));
+            if (random.next() >= survive) {
+                ++tree.roulette;
+                break;
+            }
+            throughput /= survive;
+        }
+
+        ++tree.rays[depth - 1];
+        double offset = dir.dot(surface.N) > 0 ? RAY_OFFSET : -RAY_OFFSET;
+        if (!intersect(Ray(surface.position + offset * surface.N, dir), surface))
+            break;
+    }
+    return color;
+}
+
+Color Scene::directLight(SurfacePoint const &surface,
+                         Material const &material, Random &random,
+                         RayTree &tree) {
+    Vector const &N = surface.N;
+    bool sampled = samplesLights();
+    unsigned count = sampled ? lightSamples : lights.size();
+
+    Color color(0.0, 0.0, 0.0);
+    for (unsigned pick = 0; pick != count; ++pick) {
+        double weight = 1;
+        unsigned idx = sampled ? pickLight(surface.position, N, pick, random,
+                                           weight)
+                               : pick;
+        LightPtr const &light = lights[idx];
+        Vector L = (light->position - surface.position).normalized();
+        double cosine = L.dot(N);
+        if (cosine <= 0)
+            continue;
+        weight *= visibility(surface.position, N, idx, random, tree);
+        if (weight == 0)
+            continue;
+
+        // the BRDF scatter samples: Lambert plus the normalized Phong
+        // lobe, kd * color / pi + ks * (n + 2) / (2 pi) * cos^n(alpha).
+        // A light's color is the radiance it gives a white kd = 1 surface
+        // facing it (its irradiance there is pi * color), so the pi
+        // cancels: BRDF * irradiance * cos = the terms below.
+        Vector R = 2 * cosine * N - L;
+        double specular = material.ks * (material.n + 2) / 2
+                          * pow(max(R.dot(surface.V), 0.0), material.n);
+        Color brdf = material.kd * material.color + specular;
+        color += weight * cosine * brdf * light->color;
+    }
+    return color;
+}
+
+bool Scene::samplesLights() const {
+    return lightSampling == LightSampling::SAMPLED
+           && lights.size() > lightSamples;
+}
+
+unsigned Scene::pickLight(Point const &hit, Vector const &N, unsigned index,
+                          Random &random, double &weight) const {
+    double pdf;
+    unsigned light = lightTree.sample(hit, N,
+                                      (index + random.next()) / lightSamples,
+                                      pdf);
+    weight = 1 / (lightSamples * pdf);
+    return light;
+}
+
+bool Scene::scatter(SurfacePoint const &surface, Material const &material,
+                    Random &random, Vector &dir, Color &weight) {
+    // pick a lobe with a probability proportional to its reflectance
+    double diffuse = material.kd * maxComponent(material.color);
+    double total = diffuse + material.ks + material.kr + material.kt;
+    if (total <= 0)
+        return false;
+
+    Vector D = -surface.V;
+    Vector const &N = surface.N;
+    Vector R = D - 2 * D.dot(N) * N;
+    double pick = random.next() * total;
+
+    if (pick < diffuse) {
+        // cosine weighted hemisphere: BRDF * cos / pdf = kd * color
+        dir = aroundAxis(N, sqrt(random.next()), 2 * M_PI * random.next());
+        weight = material.kd * material.color * (total / diffuse);
+        return true;
+    }
+    pick -= diffuse;
+
+    if (pick < material.ks) {
+        // normalized Phong lobe around the mirror direction
+        double cosAlpha = pow(random.next(), 1 / (material.n + 1));
+        dir = aroundAxis(R, cosAlpha, 2 * M_PI * random.next());
+        double cosine = dir.dot(N);
+        if (cosine <= 0)
+            return false;       // below the surface
+        weight = Color(1.0, 1.0, 1.0)
+                 * (total * cosine * (material.n + 2) / (material.n + 1));
+        return true;
+    }
+    pick -= material.ks;
+
+    weight = Color(total, total, total);
+    double eta = surface.inside ? material.ior : 1 / material.ior;
+    if (pick >= material.kr && refract(D, N, eta, dir))
+        return true;
+    dir = R;                    // mirror, or total internal reflection
+    return true;
+}
+
 void Scene::traceColor(Color &color, Material material,
-                       Vector N, Vector V, Point hit) {
+                       Vector N, Vector V, Point hit, RayTree &tree) {
+    phongKernel<SHADE_GENERIC>(color, material, N, V, hit, tree);
+}
+
+void Scene::shadeLights(Color &color, Material const &material,
+                        SurfacePoint const &surface, RayTree &tree) {
+    Vector const &N = surface.N;
+    Vector const &V = surface.V;
+    Point const &hit = surface.position;
+    switch (shadingKernels ? material.shading : SHADE_GENERIC) {
+        case 0:
+            phongKernel<0>(color, material, N, V, hit, tree);
+            break;
+        case SHADE_DIFFUSE:
+            phongKernel<SHADE_DIFFUSE>(color, material, N, V, hit, tree);
+            break;
+        case SHADE_SPECULAR:
+            phongKernel<SHADE_SPECULAR>(color, material, N, V, hit, tree);
+            break;
+        case SHADE_SPECULAR | SHADE_INTEGER_EXPONENT:
+            phongKernel<SHADE_SPECULAR | SHADE_INTEGER_EXPONENT>(
+                color, material, N, V, hit, tree);
+            break;
+        case SHADE_GENERIC | SHADE_INTEGER_EXPONENT:
+            phongKernel<SHADE_GENERIC | SHADE_INTEGER_EXPONENT>(
+                color, material, N, V, hit, tree);
+            break;
+        default:
+            phongKernel<SHADE_GENERIC>(color, material, N, V, hit, tree);
+            break;
+    }
+}
+
+template <unsigned Features>
+void Scene::phongKernel(Color &color, Material const &material,
+                        Vector const &N, Vector const &V, Point const &hit,
+                        RayTree &tree) {
+    bool const diffuse = Features & SHADE_DIFFUSE;
+    bool const specular = Features & SHADE_SPECULAR;
+
     color *= material.ka;
-    for (unsigned i = 0; i < lights.size(); i++) {
+    if (!diffuse && !specular)
+        return;                 // ambient only: no lights, no shadow rays
+
+    // many lights: sample some of them; area lights: sample points on
+    // them. Random per shading point.
+    bool sampled = samplesLights();
+    unsigned count = sampled ? lightSamples : lights.size();
+    Random random(hashRay(Ray(hit, V)));
+
+    for (unsigned pick = 0; pick < count; pick++) {
+        double weight = 1;
+        unsigned i = sampled ? pickLight(hit, N, pick, random, weight) : pick;
         Vector L = (lights[i]->position - hit).normalized();
-        Vector R = (2 * N.dot(L) * N - L).normalized();
-        double dot1 = max(L.dot(N), 0.0), dot2 = max(R.dot(V), 0.0);
-        color += dot1 * material.color * lights[i]->color * material.kd;
-        color += pow(dot2, material.n) * lights[i]->color * material.ks;
+        double dot1, highlight;
+        phongTerms(Features, material, N, V, L, dot1, highlight);
+        // no shadow ray needed if the light adds nothing anyway
+        if ((!diffuse || dot1 == 0) && highlight == 0)
+            continue;
+        if (shadows)
+            weight *= visibility(hit, N, i, random, tree);
+        if (weight == 0)
+            continue;
+
+        Color const &light = lights[i]->color;
+        if (weight != 1) {
+            if (diffuse && specular)
+                color += weight * (dot1 * material.color * light * material.kd
+                                   + highlight * light * material.ks);
+            else if (diffuse)
+                color += weight * (dot1 * material.color * light * material.kd);
+            else
+                color += weight * (highlight * light * material.ks);
+            continue;
+        }
+        if (diffuse)
+            color += dot1 * material.color * light * material.kd;
+        if (specular)
+            color += highlight * light * material.ks;
+    }
+}
+
+double Scene::visibility(Point const &hit, Vector const &N, unsigned idx,
+                         Random &random, RayTree &tree) {
+    Light const &light = *lights[idx];
+    if (!light.isArea())
+        return shadowed(hit, N, idx, light.position, tree) ? 0 : 1;
+
+    // one shadow ray per stratum of a grid over the light, jittered
+    unsigned side = light.grid;
+    auto visible = [&](unsigned sx, unsigned sy) {
+        double su = (sx + random.next()) / side;
+        double sv = (sy + random.next()) / side;
+        return shadowed(hit, N, idx, light.sample(hit, su, sv), tree) ? 0u
+                                                                      : 1u;
+    };
+
+    // The corner strata first: if they agree the point is taken to be
+    // fully lit or fully shadowed, only penumbra points get all strata.
+    unsigned last = side - 1;
+    unsigned lit = visible(0, 0);
+    lit += visible(last, 0);
+    lit += visible(0, last);
+    lit += visible(last, last);
+    ++tree.areaTests;
+    if (lit == 0 || lit == 4)
+        return lit / 4.0;
+
+    ++tree.penumbra;
+    for (unsigned sy = 0; sy != side; ++sy)
+        for (unsigned sx = 0; sx != side; ++sx)
+            if ((sx != 0 && sx != last) || (sy != 0 && sy != last))
+                lit += visible(sx, sy);
+    return static_cast<double>(lit) / (side * side);
+}
+
+bool Scene::shadowed(Point const &hit, Vector const &N, unsigned light,
+                     Point const &target, RayTree &tree) {
+    ++tree.shadow;
+    Point from = hit + RAY_OFFSET * N;
+    Vector D = target - from;
+    double distance = D.length();
+    Ray ray(from, D / distance);
+
+    OccluderCache &cache = occluderCache;
+    if (cache.scene != this || cache.last.size() != lights.size()) {
+        cache.scene = this;
+        cache.last.assign(lights.size(), -1);
     }
+
+    int &last = cache.last[light];
+    if (last >= 0 && static_cast<unsigned>(last) < objects.size()
+        && objects[last]->intersect(ray).t < distance) {
+        ++tree.blocked;
+        ++tree.cached;
+        return true;
+    }
+    for (unsigned idx = 0; idx != objects.size(); ++idx) {
+        if (static_cast<int>(idx) != last
+            && objects[idx]->intersect(ray).t < distance) {
+            last = idx;
+            ++tree.blocked;
+            return true;
+        }
+    }
+    return false;
 }
 
-void Scene::render(Image &img) {
+void Scene::render(Image &img, RenderOptions const &options,
+                   unsigned xOffset, unsigned yOffset) {
     unsigned w = img.width();
     unsigned h = img.height();
-    for (unsigned y = 0; y < h; ++y) {
+    unsigned samples = samplesPerPixel();
+    bool batch = options.batchShading && integrator == Integrator::PHONG
+                 && !samplesLights();
+
+    // Pixel order inside a full tile, partial tiles at the image border
+    // get their own.
+    vector<Tile> tiles = tileOrder(w, h, options.tileSize, options.order);
+    vector<GridCell> fullTile;
+    if (!tiles.empty())
+        fullTile = gridOrder(tiles[0].width, tiles[0].height, options.order);
+
+    // A tile is traced into its own block, then copied into the image
+    // a row at a time: threads share no cache lines while tracing, only
+    // (once) at the left and right edges of the copied rows.
+    auto renderTile = [&](size_t idx) {
+        Tile const &tile = tiles[idx];
+        bool full = tile.width == tiles[0].width && tile.height == tiles[0].height;
+        vector<GridCell> partialTile;
+        if (!full)
+            partialTile = gridOrder(tile.width, tile.height, options.order);
+        vector<GridCell> const &pixels = full ? fullTile : partialTile;
+        vector<Pixel> block(tile.width * tile.height);
+        RayTree tree;
+        if (batch) {
+            renderBatch(block.data(), tile, pixels, xOffset, yOffset, tree);
+        } else {
+            for (GridCell const &pixel : pixels) {
+                unsigned x = tile.x + pixel.x;
+                unsigned y = tile.y + pixel.y;
+                Color col(0.0, 0.0, 0.0);
+                for (unsigned sample = 0; sample != samples; ++sample) {
+                    double dx, dy;
+                    pixelSampleOffset(sample, dx, dy);
+                    col += trace(camera.ray(xOffset + x + dx,
+                                            yOffset + y + dy), tree);
+                }
+                block[pixel.y * tile.width + pixel.x] = col / samples;
+            }
+            tree.primary += pixels.size() * samples;
+        }
+        addTree(tree);
+
+        Image::Tile view = img.tile(tile.x, tile.y, tile.width, tile.height);
+        for (unsigned y = 0; y != tile.height; ++y)
+            copy_n(&block[y * tile.width], tile.width, view.row(y));
+    };
+
+    // Threads take the tiles in order, so the curve order is kept
+    // (roughly) across the whole pool
+    if (pool)
+        pool->parallelFor(tiles.size(), renderTile);
+    else
+        for (size_t idx = 0; idx != tiles.size(); ++idx)
+            renderTile(idx);
+}
+
+void Scene::renderBatch(Pixel *block, Tile const &tile,
+                        vector<GridCell> const &pixels,
+                        unsigned xOffset, unsigned yOffset, RayTree &tree) {
+    // first hits of the whole tile, then shade them together
+    vector<SurfacePoint> hits;
+    vector<GridCell> hitPixels;
+    hits.reserve(pixels.size());
+    hitPixels.reserve(pixels.size());
+    for (GridCell const &pixel : pixels) {
+        unsigned x = tile.x + pixel.x;
+        unsigned y = tile.y + pixel.y;
+        SurfacePoint surface;
+        if (intersect(camera.ray(xOffset + x + 0.5, yOffset + y + 0.5),
+                      surface)) {
+            hits.push_back(surface);
+            hitPixels.push_back(pixel);
+        }
+        block[pixel.y * tile.width + pixel.x] = Color(0.0, 0.0, 0.0);
+    }
+    tree.primary += pixels.size();
+
+    vector<Color> colors;
+    shadeBatch(hits, colors, tree);
+    for (size_t idx = 0; idx != hits.size(); ++idx)
+        block[hitPixels[idx].y * tile.width + hitPixels[idx].x] = colors[idx];
+}
+
+void Scene::shadeBatch(vector<SurfacePoint> const &hits,
+                       vector<Color> &colors, RayTree &tree) {
+    size_t count = hits.size();
+    size_t padded = (count + LANES - 1) / LANES * LANES;
+
+    // structure of arrays: one array per value, LANES hits per load.
+    // Padding hits look straight at a light-less origin, their results
+    // are ignored.
+    enum Value { PX, PY, PZ, NX, NY, NZ, VX, VY, VZ, DR, DG, DB, KS, EXPONENT,
+                 RED, GREEN, BLUE, DOT1, HIGHLIGHT, WEIGHT, VALUES };
+    vector<float> stream(VALUES * padded, 0.0f);
+    auto value = [&](Value which, size_t idx) -> float & {
+        return stream[which * padded + idx];
+    };
+    vector<Random> randoms;
+    randoms.reserve(count);
+    for (size_t idx = 0; idx != count; ++idx) {
+        SurfacePoint const &hit = hits[idx];
+        Material const &material = objects[hit.object]->material;
+        Color color = surfaceColor(hit, material);
+        for (int axis = 0; axis != 3; ++axis) {
+            value(Value(PX + axis), idx) = hit.position.data[axis];
+            value(Value(NX + axis), idx) = hit.N.data[axis];
+            value(Value(VX + axis), idx) = hit.V.data[axis];
+            // diffuse color, and the ambient color to add the lights to
+            double channel = color.data[axis];
+            value(Value(DR + axis), idx) = material.kd * channel;
+            value(Value(RED + axis), idx) = material.ka * channel;
+        }
+        value(KS, idx) = material.ks;
+        value(EXPONENT, idx) = material.n;
+        randoms.push_back(Random(hashRay(Ray(hit.position, hit.V))));
+    }
+    for (size_t idx = count; idx != padded; ++idx)
+        value(NZ, idx) = value(VZ, idx) = 1;
+
+    auto lanes = [&](Value which, size_t block) {
+        return loadLanes(&value(which, block));
+    };
+
+    for (unsigned light = 0; light != lights.size(); ++light) {
+        Light const &source = *lights[light];
+
+        // the Phong terms of LANES hits at once
+        for (size_t block = 0; block != padded; block += LANES) {
+            FloatLanes Nx = lanes(NX, block);
+            FloatLanes Ny = lanes(NY, block);
+            FloatLanes Nz = lanes(NZ, block);
+            FloatLanes Lx = float(source.position.x) - lanes(PX, block);
+            FloatLanes Ly = float(source.position.y) - lanes(PY, block);
+            FloatLanes Lz = float(source.position.z) - lanes(PZ, block);
+            FloatLanes scale = rsqrtLanes(Lx * Lx + Ly * Ly + Lz * Lz);
+            Lx *= scale;
+            Ly *= scale;
+            Lz *= scale;
+
+            FloatLanes NdotL = Nx * Lx + Ny * Ly + Nz * Lz;
+            FloatLanes Rx = 2.0f * NdotL * Nx - Lx;
+            FloatLanes Ry = 2.0f * NdotL * Ny - Ly;
+            FloatLanes Rz = 2.0f * NdotL * Nz - Lz;
+            FloatLanes RdotV = Rx * lanes(VX, block) + Ry * lanes(VY, block)
+                               + Rz * lanes(VZ, block);
+
+            FloatLanes dot1 = maxLanes(NdotL, splat(0));
+            FloatLanes highlight = lanes(KS, block)
+                                   * powLanes(maxLanes(RdotV, splat(0)),
+                                              lanes(EXPONENT, block));
+            storeLanes(&value(DOT1, block), dot1);
+            storeLanes(&value(HIGHLIGHT, block), highlight);
+        }
+
+        // shadow rays one by one, only where the light adds something.
+        // Decided as the scalar kernel decides, in double precision and
+        // on the untextured material, so both trace the same rays.
+        for (size_t idx = 0; idx != count; ++idx) {
+            SurfacePoint const &hit = hits[idx];
+            Material const &material = objects[hit.object]->material;
+            unsigned features = shadingKernels ? material.shading
+                                               : SHADE_GENERIC;
+            Vector L = (source.position - hit.position).normalized();
+            double dot1, highlight;
+            phongTerms(features, material, hit.N, hit.V, L, dot1, highlight);
+            bool adds = (features & SHADE_DIFFUSE && dot1 != 0)
+                        || highlight != 0;
+            value(WEIGHT, idx) =
+                !adds ? 0.0f
+                      : shadows ? visibility(hits[idx].position, hits[idx].N,
+                                             light, randoms[idx], tree)
+                                : 1.0f;
+        }
+
+        FloatLanes red = splat(source.color.r);
+        FloatLanes green = splat(source.color.g);
+        FloatLanes blue = splat(source.color.b);
+        for (size_t block = 0; block != padded; block += LANES) {
+            FloatLanes weight = lanes(WEIGHT, block);
+            FloatLanes dot1 = weight * lanes(DOT1, block);
+            FloatLanes highlight = weight * lanes(HIGHLIGHT, block);
+            storeLanes(&value(RED, block), lanes(RED, block)
+                       + (dot1 * lanes(DR, block) + highlight) * red);
+            storeLanes(&value(GREEN, block), lanes(GREEN, block)
+                       + (dot1 * lanes(DG, block) + highlight) * green);
+            storeLanes(&value(BLUE, block), lanes(BLUE, block)
+                       + (dot1 * lanes(DB, block) + highlight) * blue);
+        }
+    }
+
+    colors.resize(count);
+    for (size_t idx = 0; idx != count; ++idx) {
+        colors[idx] = Color(value(RED, idx), value(GREEN, idx),
+                            value(BLUE, idx));
+        Material const &material = objects[hits[idx].object]->material;
+        if (material.traces())
+            colors[idx] += traceSecondary(hits[idx], material, 0, 1.0, tree);
+    }
+}
+
+Color Scene::tracePixel(double x, double y, RayTree &tree, int *objectId) {
+    ++tree.primary;
+    return trace(camera.ray(x, y), tree, objectId);
+}
+
+void Scene::fillGBuffer(GBuffer &gbuffer) {
+    for (unsigned y = 0; y < gbuffer.height(); ++y) {
+        for (unsigned x = 0; x < gbuffer.width(); ++x) {
+            intersect(camera.ray(x + 0.5, y + 0.5), gbuffer(x, y));
+        }
+    }
+    stats.primaryRays += gbuffer.width() * gbuffer.height();
+}
+
+void Scene::fillFeatures(vector<DenoiseFeature> &features) {
+    unsigned w = camera.width();
+    unsigned h = camera.height();
+    features.resize(static_cast<size_t>(w) * h);
+
+    auto fillRow = [&](size_t y) {
         for (unsigned x = 0; x < w; ++x) {
-            Point pixel(x + 0.5, h - 1 - y + 0.5, 0);
-            Ray ray(eye, (pixel - eye).normalized());
-            Color col = trace(ray);
-            col.clamp();
+            DenoiseFeature &feature = features[y * w + x];
+            SurfacePoint surface;
+            feature.hit = intersect(camera.ray(x + 0.5, y + 0.5), surface);
+            if (!feature.hit) {
+                feature = DenoiseFeature{{0, 0, 0}, {0, 0, 0}, 0, false};
+                continue;
+            }
+            Color albedo = surfaceColor(surface,
+                                        objects[surface.object]->material);
+            for (int axis = 0; axis != 3; ++axis) {
+                feature.normal[axis] = surface.N.data[axis];
+                feature.albedo[axis] = albedo.data[axis];
+            }
+            feature.depth = (surface.position - camera.eye()).length();
+        }
+    };
+    if (pool)
+        pool->parallelFor(h, fillRow);
+    else
+        for (unsigned y = 0; y < h; ++y)
+            fillRow(y);
+    stats.primaryRays += features.size();
+}
+
+void Scene::shade(GBuffer const &gbuffer, Image &img) {
+    unsigned samples = samplesPerPixel();
+    for (unsigned y = 0; y < gbuffer.height(); ++y) {
+        RayTree tree;
+        for (unsigned x = 0; x < gbuffer.width(); ++x) {
+            SurfacePoint const &surface = gbuffer(x, y);
+            Color col(0.0, 0.0, 0.0);
+            if (surface.object >= 0) {
+                for (unsigned sample = 0; sample != samples; ++sample)
+                    col += shade(surface, sample, tree);
+                col /= samples;
+            }
             img(x, y) = col;
         }
+        addTree(tree);
     }
 }
 
@@ -92,8 +832,56 @@ void Scene::addLight(Light const &light) {
     lights.push_back(LightPtr(new Light(light)));
 }
 
-void Scene::setEye(Triple const &position) {
-    eye = position;
+void Scene::setCamera(Camera const &cam) {
+    camera = cam;
+    pixelSpread = camera.pixelSpread();
+}
+
+void Scene::setThreadPool(ThreadPool *threads) {
+    pool = threads;
+}
+
+void Scene::setRecursion(unsigned depth, double throughput,
+                         unsigned roulette) {
+    maxDepth = depth;
+    minThroughput = throughput;
+    rouletteDepth = roulette;
+}
+
+void Scene::setShadingKernels(bool enabled) {
+    shadingKernels = enabled;
+}
+
+void Scene::setShadows(bool enabled) {
+    shadows = enabled;
+}
+
+void Scene::setLightSampling(LightSampling mode, unsigned samples) {
+    lightSampling = mode;
+    lightSamples = samples;
+    if (mode == LightSampling::SAMPLED)
+        lightTree.build(lights);
+}
+
+void Scene::setIntegrator(Integrator kind, unsigned samples) {
+    integrator = kind;
+    pathSamples = samples;
+}
+
+Integrator Scene::getIntegrator() const {
+    return integrator;
+}
+
+unsigned Scene::samplesPerPixel() const {
+    return integrator == Integrator::PATH ? pathSamples : 1;
+}
+
+Camera const &Scene::getCamera() const {
+    return camera;
+}
+
+ThreadPool *Scene::getThreadPool() const {
+    return pool;
 }
 
 unsigned Scene::getNumObject() {
@@ -103,3 +891,15 @@ unsigned Scene::getNumObject() {
 unsigned Scene::getNumLights() {
     return lights.size();
 }
+
+LightPtr Scene::getLight(unsigned idx) const {
+    return lights.at(idx);
+}
+
+ObjectPtr Scene::getObject(unsigned idx) const {
+    return objects.at(idx);
+}
+
+RenderStats const &Scene::getStats() const {
+    return stats;
+}
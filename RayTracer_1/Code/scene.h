@@ -1,39 +1,198 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
+#include "camera.h"
 #include "light.h"
+#include "lighttree.h"
 #include "object.h"
+#include "renderoptions.h"
+#include "renderstats.h"
+#include "surfacepoint.h"
 #include "triple.h"
 
 #include <vector>
 
 // Forward declerations
+struct DenoiseFeature;
+class GBuffer;
 class Ray;
 class Image;
+struct Pixel;
+class ThreadPool;
+class Random;
+
+// How the color of a surface point is computed: PHONG shades it with the
+// Phong model (plus mirror / refraction rays), PATH estimates all light
+// arriving there, including light bounced off other objects, by tracing
+// random paths (Monte Carlo path tracing).
+enum class Integrator
+{
+    PHONG,
+    PATH
+};
+
+// Which lights light a shading point: EXACT adds all of them, SAMPLED
+// picks a fixed number of them from a LightTree and weights them so the
+// expected color is the same (for scenes with many lights).
+enum class LightSampling
+{
+    EXACT,
+    SAMPLED
+};
 
 class Scene
 {
     std::vector<ObjectPtr> objects;
     std::vector<LightPtr> lights;   // no ptr needed, but kept for consistency
-    Point eye;
+    Camera camera;
+    RenderStats stats;
+    ThreadPool *pool = nullptr;     // renders tiles in parallel if set
+
+    // reflected / refracted rays: deepest bounce, weight below which a
+    // path ends, depth from which Russian roulette ends paths
+    unsigned maxDepth = 8;
+    double minThroughput = 0.01;
+    unsigned rouletteDepth = 4;
+
+    Integrator integrator = Integrator::PHONG;
+    unsigned pathSamples = 16;      // path integrator: samples per pixel
+    bool shadows = true;            // Phong: trace shadow rays
+    bool shadingKernels = true;     // Phong: per material kernels, or
+                                    // the generic one for all
+
+    LightSampling lightSampling = LightSampling::EXACT;
+    unsigned lightSamples = 4;      // SAMPLED: lights per shading point
+    LightTree lightTree;
+    double pixelSpread = 0;         // of the camera, see Camera::pixelSpread
 
     public:
 
-        // trace a ray into the scene and return the color
-        Color trace(Ray const &ray);
+        // trace a ray into the scene and return the color, the index of
+        // the hit object (-1: none) is stored in objectId if given. The
+        // rays it takes are counted in tree, see addTree.
+        Color trace(Ray const &ray, RayTree &tree, int *objectId = nullptr);
+
+        // first hit of the ray, false if it hits nothing
+        bool intersect(Ray const &ray, SurfacePoint &surface);
+
+        // color (unclamped) of a hit surface point. The path integrator
+        // returns one random estimate, different for every sample index.
+        Color shade(SurfacePoint const &surface, unsigned sample,
+                    RayTree &tree);
 
-        // render the scene to the given image
-        void render(Image &img);
+        // relighting: store the first hit of every pixel centre, and
+        // shade an image from stored hits without tracing primary rays
+        void fillGBuffer(GBuffer &gbuffer);
+        void shade(GBuffer const &gbuffer, Image &img);
+
+        // denoising: normal, depth and albedo of the first hit of every
+        // pixel centre of the frame, row major
+        void fillFeatures(std::vector<DenoiseFeature> &features);
+
+        // render the scene to the given image, which holds the window of
+        // the frame starting at (xOffset, yOffset) (all of it by default)
+        void render(Image &img, RenderOptions const &options,
+                    unsigned xOffset = 0, unsigned yOffset = 0);
+
+        // trace the primary ray through frame position (x, y), see
+        // Camera::ray. Returns the unclamped color.
+        Color tracePixel(double x, double y, RayTree &tree,
+                         int *objectId = nullptr);
+
+        // add the rays counted in tree to the stats. The counters are
+        // shared by all threads: call it once per tile (or row), not
+        // per ray.
+        void addTree(RayTree const &tree);
 
         void traceColor(Color &color, Material material,
-                        Vector N, Vector V, Point hit);
+                        Vector N, Vector V, Point hit, RayTree &tree);
 
         void addObject(ObjectPtr obj);
         void addLight(Light const &light);
-        void setEye(Triple const &position);
+        void setCamera(Camera const &cam);
+        void setThreadPool(ThreadPool *threads);
+        void setRecursion(unsigned depth, double throughput,
+                          unsigned roulette);
+        void setIntegrator(Integrator kind, unsigned samples);
+        void setShadows(bool enabled);
+        void setShadingKernels(bool enabled);
+        // call once all lights are added
+        void setLightSampling(LightSampling mode, unsigned samples);
+        Integrator getIntegrator() const;
+        // samples per pixel of render() and shade(GBuffer, Image)
+        unsigned samplesPerPixel() const;
+        Camera const &getCamera() const;
+        ThreadPool *getThreadPool() const;
 
         unsigned getNumObject();
         unsigned getNumLights();
+        LightPtr getLight(unsigned idx) const;
+        ObjectPtr getObject(unsigned idx) const;
+        RenderStats const &getStats() const;
+
+    private:
+
+        Color shade(SurfacePoint const &surface, unsigned depth,
+                    double throughput, RayTree &tree);
+        // material color at the hit, times the texture if it has one
+        Color surfaceColor(SurfacePoint const &surface,
+                           Material const &material) const;
+        // reflected and refracted light at a surface hit at depth
+        Color traceSecondary(SurfacePoint const &surface,
+                             Material const &material, unsigned depth,
+                             double throughput, RayTree &tree);
+        // a reflected or refracted ray of the given depth and weight
+        Color traceBounce(Ray const &ray, unsigned depth, double throughput,
+                          RayTree &tree);
+
+        // render: trace the first hits of a tile's pixels, then shade
+        // them in one batch, into block (tile.width pixels per row)
+        void renderBatch(Pixel *block, Tile const &tile,
+                         std::vector<GridCell> const &pixels,
+                         unsigned xOffset, unsigned yOffset, RayTree &tree);
+        // the Phong colors of many hits (plus their reflected and
+        // refracted light), LANES hits at a time in float precision.
+        // Per channel and unit of light color a light's term differs from
+        // the scalar kernels' by at most 1e-5 + 1.5e-7 * n (n: specular
+        // exponent; the float rounding of R.V raised to the power n).
+        void shadeBatch(std::vector<SurfacePoint> const &hits,
+                        std::vector<Color> &colors, RayTree &tree);
+
+        // ambient, diffuse and specular light at a surface, shaded by the
+        // kernel for the material's features (traceColor: the generic one)
+        void shadeLights(Color &color, Material const &material,
+                         SurfacePoint const &surface, RayTree &tree);
+        template <unsigned Features>
+        void phongKernel(Color &color, Material const &material,
+                         Vector const &N, Vector const &V, Point const &hit,
+                         RayTree &tree);
+
+        // fraction of the light visible from hit (with normal N): 0 or 1
+        // for point lights, estimated adaptively for area lights
+        double visibility(Point const &hit, Vector const &N, unsigned idx,
+                          Random &random, RayTree &tree);
+        // true if an object lies between hit and target (a point of the
+        // light), the light's last occluder on this thread is tried first
+        bool shadowed(Point const &hit, Vector const &N, unsigned light,
+                      Point const &target, RayTree &tree);
+
+        // path integrator: one path starting at surface
+        Color tracePath(SurfacePoint const &surface, unsigned sample,
+                        RayTree &tree);
+        // light arriving directly from the lights, reflected towards V
+        Color directLight(SurfacePoint const &surface,
+                          Material const &material, Random &random,
+                          RayTree &tree);
+        // true if shading samples lights instead of adding all of them
+        bool samplesLights() const;
+        // the index-th of lightSamples stratified picks for a point,
+        // weight: 1 / (lightSamples * probability)
+        unsigned pickLight(Point const &hit, Vector const &N, unsigned index,
+                           Random &random, double &weight) const;
+        // picks a reflection lobe and a direction in it, false if the
+        // path is absorbed. weight: BRDF * cos / probability.
+        bool scatter(SurfacePoint const &surface, Material const &material,
+                     Random &random, Vector &dir, Color &weight);
 };
 
 #endif
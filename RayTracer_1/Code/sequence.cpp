@@ -0,0 +1,211 @@
+#include "sequence.h"
+
+#include "image.h"
+#include "raytracer.h"
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <glob.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace
+{
+    typedef chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // scene.json -> scene.png
+    string outputName(string const &ifname)
+    {
+        string ofname = ifname;
+        size_t dot = ofname.find_last_of('.');
+        if (dot != string::npos && ofname.find('/', dot) == string::npos)
+            ofname.erase(dot);
+        return ofname + ".png";
+    }
+
+    // PNG being written on the pool
+    struct Encoding
+    {
+        string ofname;
+        future<void> done;
+        shared_ptr<double> seconds;
+    };
+
+    // waits for a running encode (if any) and reports it, false if
+    // writing the file failed
+    bool finishEncoding(Encoding &encoding)
+    {
+        if (!encoding.done.valid())
+            return true;
+        try
+        {
+            encoding.done.get();
+        }
+        catch (exception const &ex)
+        {
+            cerr << "Error: writing " << encoding.ofname << ": " << ex.what()
+                 << '\n';
+            return false;
+        }
+        cout << "Wrote " << encoding.ofname << " in " << *encoding.seconds
+             << " s.\n";
+        return true;
+    }
+
+    double percentage(unsigned long long part, unsigned long long total)
+    {
+        return total == 0 ? 0 : 100.0 * part / total;
+    }
+}
+
+SequenceRenderer::SequenceRenderer(RenderOptions const &options)
+:
+    d_options(options),
+    d_models(options.cacheLimit),
+    d_pool(options.threads)
+{}
+
+unsigned SequenceRenderer::render(vector<Job> const &jobs)
+{
+    Clock::time_point start = Clock::now();
+    Encoding encoding;      // of the previous scene
+    unsigned failed = 0;
+
+    cout << "Rendering " << jobs.size() << " scenes on " << d_pool.size()
+         << " threads.\n";
+
+    for (size_t idx = 0; idx != jobs.size(); ++idx)
+    {
+        Job const &job = jobs[idx];
+        cout << "Scene " << idx + 1 << '/' << jobs.size() << ": "
+             << job.scene << '\n';
+
+        Clock::time_point loadStart = Clock::now();
+        unsigned long long hits = d_models.hits();
+        unsigned long long misses = d_models.misses();
+
+        Raytracer raytracer;
+        raytracer.useModelCache(d_models);
+        raytracer.useThreadPool(d_pool);
+        if (!raytracer.readScene(job.scene))
+        {
+            cerr << "Error: reading scene from " << job.scene
+                 << " failed - scene skipped.\n";
+            ++failed;
+            continue;
+        }
+        double loadTime = secondsSince(loadStart);
+        hits = d_models.hits() - hits;
+        misses = d_models.misses() - misses;
+
+        Clock::time_point traceStart = Clock::now();
+        Image img;
+        try
+        {
+            img = raytracer.renderImage(job.output, d_options);
+        }
+        catch (exception const &ex)
+        {
+            cerr << "Error: rendering " << job.scene << ": " << ex.what()
+                 << " - scene skipped.\n";
+            ++failed;
+            continue;
+        }
+        double traceTime = secondsSince(traceStart);
+
+        // at most one scene is being encoded at a time
+        if (!finishEncoding(encoding))
+            ++failed;
+        encoding.ofname = job.output;
+        encoding.seconds = make_shared<double>(0);
+        auto image = make_shared<Image>(move(img));
+        auto seconds = encoding.seconds;
+        string ofname = job.output;
+        ToneMap map = d_options.toneMap;
+        PngEncoder png(d_options.pngLevel, &d_pool);
+        encoding.done = d_pool.submit([image, seconds, ofname, map, png]()
+                                      {
+                                          Clock::time_point encodeStart =
+                                              Clock::now();
+                                          image->write(ofname, map, png);
+                                          *seconds = secondsSince(encodeStart);
+                                      });
+
+        cout << "Scene " << idx + 1 << ": load " << loadTime << " s, trace "
+             << traceTime << " s, models " << hits << " cached / " << misses
+             << " loaded.\n";
+    }
+    if (!finishEncoding(encoding))
+        ++failed;
+
+    double total = secondsSince(start);
+    size_t rendered = jobs.size() - failed;
+    unsigned long long requests = d_models.hits() + d_models.misses();
+    cout << "Rendered " << rendered << " scenes in " << total << " s";
+    if (rendered != 0)
+        cout << " (" << total / rendered << " s per scene)";
+    cout << ", " << d_models.misses() << " models loaded, "
+         << d_models.hits() << " reused (" << percentage(d_models.hits(),
+                                                        requests)
+         << "% hit rate), " << d_models.evictions() << " evicted.\n";
+    return failed;
+}
+
+vector<SequenceRenderer::Job> SequenceRenderer::findScenes(string const &where)
+{
+    string pattern = where;
+    struct stat info;
+    if (stat(where.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+        pattern += "/*.json";
+
+    vector<Job> jobs;
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+    {
+        for (size_t idx = 0; idx != matches.gl_pathc; ++idx)
+        {
+            string scene = matches.gl_pathv[idx];
+            jobs.push_back(Job{scene, outputName(scene)});
+        }
+    }
+    globfree(&matches);
+    return jobs;
+}
+
+vector<SequenceRenderer::Job> SequenceRenderer::readManifest(
+    string const &filename)
+{
+    ifstream in(filename);
+    if (!in)
+        throw runtime_error("cannot read manifest " + filename);
+
+    vector<Job> jobs;
+    string line;
+    for (unsigned lineNr = 1; getline(in, line); ++lineNr)
+    {
+        istringstream fields(line);
+        Job job;
+        if (!(fields >> job.scene) || job.scene[0] == '#')
+            continue;
+
+        string extra;
+        if (!(fields >> job.output) || fields >> extra)
+            throw runtime_error(filename + ":" + to_string(lineNr)
+                                + ": expected \"scene.json output.png\"");
+        jobs.push_back(job);
+    }
+    return jobs;
+}
@@ -0,0 +1,44 @@
+#ifndef SEQUENCE_H_
+#define SEQUENCE_H_
+
+#include "modelcache.h"
+#include "renderoptions.h"
+#include "threadpool.h"
+
+#include <string>
+#include <vector>
+
+// Renders many scene files (the frames of an animation, or a batch of
+// unrelated scenes) in one process. Models are loaded through a shared
+// cache, tiles are traced on a shared thread pool and the PNG of scene N
+// is encoded on the pool while scene N + 1 is traced.
+class SequenceRenderer
+{
+    public:
+        struct Job
+        {
+            std::string scene;
+            std::string output;
+        };
+
+    private:
+        RenderOptions const &d_options;
+        ModelCache d_models;
+        ThreadPool d_pool;
+
+    public:
+        explicit SequenceRenderer(RenderOptions const &options);
+
+        // renders every job, returns the number of jobs that failed
+        unsigned render(std::vector<Job> const &jobs);
+
+        // the .json files in a directory, or the files matching a glob
+        // pattern, sorted by name, each rendered to a PNG next to it
+        static std::vector<Job> findScenes(std::string const &where);
+
+        // "scene.json output.png" per line, blank lines and lines starting
+        // with # are skipped. Throws on unreadable files or bad lines.
+        static std::vector<Job> readManifest(std::string const &filename);
+};
+
+#endif
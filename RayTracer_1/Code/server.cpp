@@ -0,0 +1,265 @@
+#include "server.h"
+
+#include "raytracer.h"
+#include "socketio.h"
+
+#include "json/json.h"
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    size_t const MAX_REQUEST = 64 << 20;    // bytes, inline scenes included
+
+    // Options that configure the daemon itself, not a single render
+    char const *const SERVER_OPTIONS[] =
+        {"serve", "max-jobs", "threads", "cache-limit", "sequence", "batch",
+         "coordinate", "worker", "bench-shading"};
+
+    double secondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now()
+                                        - start).count();
+    }
+
+    runtime_error systemError(string const &what)
+    {
+        return runtime_error(what + ": " + strerror(errno));
+    }
+
+    json failure(string const &message)
+    {
+        return json{{"ok", false}, {"error", message}};
+    }
+}
+
+RenderServer::RenderServer(RenderOptions const &options)
+:
+    d_options(options),
+    d_models(options.cacheLimit),
+    d_pool(options.threads),
+    d_start(Clock::now()),
+    d_listen(-1),
+    d_stopping(false),
+    d_running(0),
+    d_queued(0),
+    d_completed(0),
+    d_failed(0),
+    d_rays(0),
+    d_renderSeconds(0)
+{}
+
+RenderServer::~RenderServer()
+{
+    if (d_listen >= 0)
+        close(d_listen);
+}
+
+void RenderServer::serve(string const &socketPath)
+{
+    d_listen = listenUnix(socketPath);
+    cout << "Serving on " << socketPath << " (" << d_options.maxJobs
+         << " jobs at once, " << d_pool.size() << " threads).\n";
+
+    while (true)
+    {
+        int client = accept(d_listen, nullptr, nullptr);
+        lock_guard<mutex> lock(d_mutex);
+        if (d_stopping)
+        {
+            if (client >= 0)
+                close(client);
+            break;
+        }
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            throw systemError("accept");
+        }
+        d_clients.insert(client);
+        thread(&RenderServer::connection, this, client).detach();
+    }
+
+    // wait for the connections (and their running jobs) to finish
+    unique_lock<mutex> lock(d_mutex);
+    d_changed.wait(lock, [this]() { return d_clients.empty(); });
+    lock.unlock();
+
+    closeUnixListener(d_listen, socketPath);
+    d_listen = -1;
+    cout << "Stopped after " << d_completed << " jobs.\n";
+}
+
+void RenderServer::connection(int client)
+{
+    string buffer;
+    string line;
+    while (readLine(client, buffer, line, MAX_REQUEST))
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+        if (!writeAll(client, respond(line) + '\n'))
+            break;
+    }
+
+    close(client);
+    lock_guard<mutex> lock(d_mutex);
+    d_clients.erase(client);
+    d_changed.notify_all();
+}
+
+string RenderServer::respond(string const &line)
+{
+    json reply;
+    try
+    {
+        json request = json::parse(line);
+        string command = request.at("command");
+        if (command == "render")
+            reply = render(request);
+        else if (command == "status")
+            reply = status();
+        else if (command == "shutdown")
+        {
+            stop();
+            reply = json{{"ok", true}};
+        }
+        else
+            reply = failure("unknown command: " + command);
+    }
+    catch (exception const &ex)
+    {
+        reply = failure(ex.what());
+    }
+    return reply.dump();
+}
+
+json RenderServer::render(json const &request)
+{
+    RenderOptions options;
+    if (request.count("options"))
+    {
+        for (auto const &option : request["options"].items())
+        {
+            for (char const *name : SERVER_OPTIONS)
+                if (option.key() == name)
+                    throw invalid_argument("not a job option: " + option.key());
+            json const &value = option.value();
+            parseRenderOption("--" + option.key(),
+                              value.is_string() ? value.get<string>()
+                                                : value.dump(),
+                              options);
+        }
+    }
+    checkRenderOptions(options);
+
+    json const &sceneNode = request.at("scene");
+    string output = request.at("output");
+
+    acquireSlot();
+    Clock::time_point start = Clock::now();
+    unsigned long long rays = 0;
+    try
+    {
+        Raytracer raytracer;
+        raytracer.useModelCache(d_models);
+        raytracer.useThreadPool(d_pool);
+
+        bool read;
+        if (sceneNode.is_string())
+            read = raytracer.readScene(sceneNode.get<string>());
+        else
+        {
+            istringstream text(sceneNode.dump());
+            read = raytracer.readScene(text);
+        }
+        if (!read)
+            throw runtime_error("reading the scene failed");
+
+        raytracer.renderToFile(output, options);
+        rays = raytracer.getStats().primaryRays;
+    }
+    catch (...)
+    {
+        releaseSlot(false, rays, secondsSince(start));
+        throw;
+    }
+
+    double seconds = secondsSince(start);
+    releaseSlot(true, rays, seconds);
+    return json{{"ok", true}, {"output", output}, {"seconds", seconds},
+                {"rays", rays}};
+}
+
+json RenderServer::status()
+{
+    lock_guard<mutex> lock(d_mutex);
+    return json{
+        {"ok", true},
+        {"uptime", secondsSince(d_start)},
+        {"connections", d_clients.size()},
+        {"threads", d_pool.size()},
+        {"jobs", {{"running", d_running},
+                  {"queued", d_queued},
+                  {"limit", d_options.maxJobs},
+                  {"completed", d_completed},
+                  {"failed", d_failed}}},
+        {"renderSeconds", d_renderSeconds},
+        {"rays", d_rays},
+        {"raysPerSecond", d_renderSeconds > 0 ? d_rays / d_renderSeconds : 0},
+        {"models", {{"loaded", d_models.misses()},
+                    {"reused", d_models.hits()},
+                    {"evicted", d_models.evictions()},
+                    {"bytes", d_models.bytes()}}}
+    };
+}
+
+void RenderServer::stop()
+{
+    lock_guard<mutex> lock(d_mutex);
+    d_stopping = true;
+
+    // wake up accept() and idle connections, replies can still be sent
+    shutdown(d_listen, SHUT_RDWR);
+    for (int client : d_clients)
+        shutdown(client, SHUT_RD);
+    d_changed.notify_all();
+}
+
+void RenderServer::acquireSlot()
+{
+    unique_lock<mutex> lock(d_mutex);
+    ++d_queued;
+    d_changed.wait(lock, [this]()
+                   {
+                       return d_stopping || d_running < d_options.maxJobs;
+                   });
+    --d_queued;
+    if (d_stopping)
+        throw runtime_error("server is shutting down");
+    ++d_running;
+}
+
+void RenderServer::releaseSlot(bool succeeded, unsigned long long rays,
+                               double seconds)
+{
+    lock_guard<mutex> lock(d_mutex);
+    --d_running;
+    ++(succeeded ? d_completed : d_failed);
+    d_rays += rays;
+    d_renderSeconds += seconds;
+    d_changed.notify_all();
+}
@@ -0,0 +1,74 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "modelcache.h"
+#include "renderoptions.h"
+#include "threadpool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "json/json_fwd.h"
+
+// Render daemon: accepts render jobs on a Unix domain socket, so short
+// renders do not pay for process startup and model loading. Clients send
+// one JSON request per line and get one JSON reply line back:
+//
+//  {"command": "render", "scene": "scene.json" or {...scene...},
+//   "output": "out.png", "options": {"order": "hilbert", ...}}
+//  {"command": "status"}
+//  {"command": "shutdown"}
+//
+// Options are the command line options without "--". Models stay loaded
+// between jobs, at most options.maxJobs jobs render at once (sharing one
+// thread pool for their tiles), others wait for a free slot.
+class RenderServer
+{
+    typedef std::chrono::steady_clock Clock;
+
+    RenderOptions const &d_options;
+    ModelCache d_models;
+    ThreadPool d_pool;
+    Clock::time_point d_start;
+
+    int d_listen;                   // listening socket, -1 if not serving
+
+    std::mutex d_mutex;             // guards everything below
+    std::condition_variable d_changed;
+    bool d_stopping;
+    std::set<int> d_clients;        // open client connections
+    unsigned d_running;             // jobs rendering
+    unsigned d_queued;              // jobs waiting for a slot
+    unsigned long long d_completed;
+    unsigned long long d_failed;
+    unsigned long long d_rays;
+    double d_renderSeconds;
+
+    public:
+        explicit RenderServer(RenderOptions const &options);
+        ~RenderServer();
+
+        RenderServer(RenderServer const &other) = delete;
+        RenderServer &operator=(RenderServer const &other) = delete;
+
+        // listens on socketPath until a shutdown request, throws
+        // runtime_error if the socket cannot be set up
+        void serve(std::string const &socketPath);
+
+    private:
+        void connection(int client);    // reads requests until EOF
+        std::string respond(std::string const &line);
+
+        nlohmann::json render(nlohmann::json const &request);
+        nlohmann::json status();
+        void stop();
+
+        void acquireSlot();
+        void releaseSlot(bool succeeded, unsigned long long rays,
+                         double seconds);
+};
+
+#endif
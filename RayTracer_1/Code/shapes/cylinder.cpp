@@ -9,6 +9,18 @@ Hit Cylinder::intersect(Ray const &ray)
     return Hit::NO_HIT(); // placeholder
 }
 
+// box around both end caps (direction is the axis, base to top)
+bool Cylinder::bounds(Point &lo, Point &hi) const
+{
+    Point top = position + direction;
+    for (unsigned idx = 0; idx != 3; ++idx)
+    {
+        lo.data[idx] = fmin(position.data[idx], top.data[idx]) - radius;
+        hi.data[idx] = fmax(position.data[idx], top.data[idx]) + radius;
+    }
+    return true;
+}
+
 Cylinder::Cylinder(Point const &pos, Vector const &direction, double radius)
 :
     position(pos),
@@ -13,6 +13,7 @@ class Cylinder: public Object
         Cylinder(Point const &pos, Vector const &direction, double radius);
 
         virtual Hit intersect(Ray const &ray);
+        virtual bool bounds(Point &lo, Point &hi) const;
 };
 
 #endif
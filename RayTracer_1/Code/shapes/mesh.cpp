@@ -16,11 +16,12 @@ Hit Mesh::intersect(Ray const &ray) {
     // Replace the return of a NO_HIT by determining the intersection based
     // on the ray and this class's data members.
     int intersect = 0;
-    ObjectPtr tri;
     Hit isIntersected(numeric_limits<double>::infinity(), Vector());
 
     for (size_t i = 0; i < d_tris.size(); i++) {
-        tri = d_tris[i];
+        // no copy: copying the shared_ptr is an atomic update shared by
+        // all threads
+        ObjectPtr const &tri = d_tris[i];
         Hit hit = tri->intersect(ray);
         if (hit.t < isIntersected.t) {
             isIntersected = hit;
@@ -33,11 +34,33 @@ Hit Mesh::intersect(Ray const &ray) {
     return Hit::NO_HIT();
 }
 
-Mesh::Mesh(string const &filename, Point const &position, Vector const &rotation, Vector const &scale) {
-    OBJLoader model(filename);
-    d_tris.reserve(model.numTriangles());
-    vector<Vertex> vertices = model.vertex_data();
-    for (size_t tri = 0; tri != model.numTriangles(); ++tri) {
+bool Mesh::bounds(Point &lo, Point &hi) const {
+    if (d_tris.empty())
+        return false;
+
+    d_tris[0]->bounds(lo, hi);
+    for (ObjectPtr const &tri : d_tris) {
+        Point triLo, triHi;
+        tri->bounds(triLo, triHi);
+        for (unsigned idx = 0; idx != 3; ++idx) {
+            lo.data[idx] = min(lo.data[idx], triLo.data[idx]);
+            hi.data[idx] = max(hi.data[idx], triHi.data[idx]);
+        }
+    }
+    return true;
+}
+
+Mesh::Mesh(string const &filename, Point const &position, Vector const &rotation, Vector const &scale)
+        :
+        Mesh(OBJLoader(filename).vertex_data(), position, rotation, scale) {
+    cout << "Loaded model: " << filename << " with " <<
+         d_tris.size() << " triangles.\n";
+}
+
+Mesh::Mesh(vector<Vertex> const &vertices, Point const &position, Vector const &rotation, Vector const &scale) {
+    size_t numTriangles = vertices.size() / 3;
+    d_tris.reserve(numTriangles);
+    for (size_t tri = 0; tri != numTriangles; ++tri) {
         Vertex one = vertices[tri * 3];
         Point v0(one.x, one.y, one.z);
 
@@ -131,9 +154,10 @@ Mesh::Mesh(string const &filename, Point const &position, Vector const &rotation
         v1 += position;
         v2 += position;
 
-        d_tris.push_back(ObjectPtr(new Triangle(v0, v1, v2)));
+        Triangle *triangle = new Triangle(v0, v1, v2);
+        double const u[3] = {one.u, two.u, three.u};
+        double const v[3] = {one.v, two.v, three.v};
+        triangle->setTexCoords(u, v);
+        d_tris.push_back(ObjectPtr(triangle));
     }
-
-    cout << "Loaded model: " << filename << " with " <<
-         model.numTriangles() << " triangles.\n";
 }
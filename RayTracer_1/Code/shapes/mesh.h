@@ -2,6 +2,7 @@
 #define MESH_H_
 
 #include "../object.h"
+#include "../vertex.h"
 
 #include <string>
 #include <vector>
@@ -16,7 +17,14 @@ class Mesh: public Object
              Vector const &rotation,
              Vector const &scale);
 
+        // from already loaded vertex data (three vertices per triangle)
+        Mesh(std::vector<Vertex> const &vertices,
+             Point const &position,
+             Vector const &rotation,
+             Vector const &scale);
+
         virtual Hit intersect(Ray const &ray);
+        virtual bool bounds(Point &lo, Point &hi) const;
 };
 
 
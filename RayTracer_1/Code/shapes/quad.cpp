@@ -1,6 +1,7 @@
 #include "quad.h"
 
 
+#include <algorithm>
 #include <limits>
 
 using namespace std;
@@ -18,6 +19,17 @@ Hit Quad::intersect(Ray const &ray) {
     return Hit::NO_HIT();
 }
 
+bool Quad::bounds(Point &lo, Point &hi) const {
+    Point lo2, hi2;
+    tri1->bounds(lo, hi);
+    tri2->bounds(lo2, hi2);
+    for (unsigned idx = 0; idx != 3; ++idx) {
+        lo.data[idx] = min(lo.data[idx], lo2.data[idx]);
+        hi.data[idx] = max(hi.data[idx], hi2.data[idx]);
+    }
+    return true;
+}
+
 Quad::Quad(Point const &v0,
            Point const &v1,
            Point const &v2,
@@ -25,4 +37,12 @@ Quad::Quad(Point const &v0,
     // Store and/or process the points defining the quad here.
     tri1 = new Triangle(v0, v1, v2);
     tri2 = new Triangle(v0, v2, v3);
+
+    // the texture covers the quad once, (0, 0) at v0 and (1, 0) at v1
+    double const tu1[3] = {0, 1, 1};
+    double const tv1[3] = {0, 0, 1};
+    double const tu2[3] = {0, 1, 0};
+    double const tv2[3] = {0, 1, 1};
+    tri1->setTexCoords(tu1, tv1);
+    tri2->setTexCoords(tu2, tv2);
 }
@@ -14,6 +14,7 @@ public:
     Triangle *tri1, *tri2;
 
     virtual Hit intersect(Ray const &ray);
+    virtual bool bounds(Point &lo, Point &hi) const;
 };
 
 #endif
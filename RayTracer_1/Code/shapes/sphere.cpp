@@ -1,5 +1,6 @@
 #include "sphere.h"
 
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
@@ -75,7 +76,20 @@ Hit Sphere::intersect(Ray const &ray) {
     t = t1;
     Point ray1 = ray.O + (ray.D * t);
     Vector N = (ray1 - position).normalized();
-    return Hit(t, N);
+
+    // longitude and latitude (poles on the y axis), the equator is 2 pi r
+    // long, a meridian pi r
+    Hit hit(t, N);
+    hit.u = 0.5 + atan2(N.z, N.x) / (2 * M_PI);
+    hit.v = 0.5 + asin(max(-1.0, min(N.y, 1.0))) / M_PI;
+    hit.uvScale = 1 / (M_PI * r * sqrt(2.0));
+    return hit;
+}
+
+bool Sphere::bounds(Point &lo, Point &hi) const {
+    lo = position - r;
+    hi = position + r;
+    return true;
 }
 
 Sphere::Sphere(Point const &pos, double
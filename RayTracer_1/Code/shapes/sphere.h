@@ -8,6 +8,7 @@ public:
     Sphere(Point const &pos, double radius);
 
     virtual Hit intersect(Ray const &ray);
+    virtual bool bounds(Point &lo, Point &hi) const;
 
     Point const position;
     double const r;
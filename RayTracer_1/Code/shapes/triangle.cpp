@@ -1,5 +1,10 @@
 #include "triangle.h"
 
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
 /*
  * Write the function using Möller-Trumbore algorithm
  * ray = ray.O + t*ray.D
@@ -34,9 +39,11 @@ Hit Triangle::intersect(Ray const &ray) {
 
     t = v0v2.dot(qvec) * indeterminant;
     if (t > EPSILON) {
-        N = (v1 - v0).cross(v2 - v0);
-        N.normalize();
-        return Hit(t, N);
+        Hit hit(t, N);
+        hit.u = (1 - u - v) * texU[0] + u * texU[1] + v * texU[2];
+        hit.v = (1 - u - v) * texV[0] + u * texV[1] + v * texV[2];
+        hit.uvScale = uvScale;
+        return hit;
     } else {
         return Hit::NO_HIT();
     }
@@ -47,6 +54,14 @@ Hit Triangle::intersect(Ray const &ray) {
 //    return Hit(t, N);
 }
 
+bool Triangle::bounds(Point &lo, Point &hi) const {
+    for (unsigned idx = 0; idx != 3; ++idx) {
+        lo.data[idx] = min(v0.data[idx], min(v1.data[idx], v2.data[idx]));
+        hi.data[idx] = max(v0.data[idx], max(v1.data[idx], v2.data[idx]));
+    }
+    return true;
+}
+
 Triangle::Triangle(Point const &v0,
                    Point const &v1,
                    Point const &v2)
@@ -56,4 +71,18 @@ Triangle::Triangle(Point const &v0,
         v2(v2) {
     // Calculate the surface normal here and store it in the N,
     // which is declared in the header. It can then be used in the intersect function.
+    N = (v1 - v0).cross(v2 - v0);
+    N.normalize();
+    setTexCoords(texU, texV);
+}
+
+void Triangle::setTexCoords(double const u[3], double const v[3]) {
+    copy(u, u + 3, texU);
+    copy(v, v + 3, texV);
+
+    // square root of the ratio of the areas in texture and in scene space
+    double uvArea = fabs((texU[1] - texU[0]) * (texV[2] - texV[0])
+                         - (texU[2] - texU[0]) * (texV[1] - texV[0]));
+    double area = (v1 - v0).cross(v2 - v0).length();
+    uvScale = area > 0 ? sqrt(uvArea / area) : 0;
 }
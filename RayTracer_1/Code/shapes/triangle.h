@@ -10,6 +10,11 @@ public:
              Point const &v2);
 
     virtual Hit intersect(Ray const &ray);
+    virtual bool bounds(Point &lo, Point &hi) const;
+
+    // texture coordinates of v0, v1 and v2, by default (0, 0), (1, 0)
+    // and (0, 1)
+    void setTexCoords(double const u[3], double const v[3]);
 
     double const EPSILON = 0.00000001;
 
@@ -17,6 +22,9 @@ public:
     Point v1;
     Point v2;
     Vector N;
+    double texU[3] = {0, 1, 0};
+    double texV[3] = {0, 0, 1};
+    double uvScale;
 };
 
 #endif
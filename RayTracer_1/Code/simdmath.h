@@ -0,0 +1,107 @@
+#ifndef SIMDMATH_H_
+#define SIMDMATH_H_
+
+#include <cstdint>
+#include <cstring>
+
+// Math on LANES floats at once, written with the GCC / Clang vector
+// extensions: a FloatLanes is one vector register of the target, 8 floats
+// when compiled for AVX, else 4 (SSE, NEON). Used to shade batches of
+// hits.
+
+#ifdef __AVX__
+unsigned const LANES = 8;
+#else
+unsigned const LANES = 4;
+#endif
+
+typedef float FloatLanes __attribute__((vector_size(LANES * sizeof(float))));
+typedef int32_t IntLanes __attribute__((vector_size(LANES * sizeof(int32_t))));
+
+inline FloatLanes splat(float value)
+{
+    return FloatLanes{} + value;
+}
+
+// unaligned load / store of LANES floats
+inline FloatLanes loadLanes(float const *from)
+{
+    FloatLanes lanes;
+    memcpy(&lanes, from, sizeof lanes);
+    return lanes;
+}
+
+inline void storeLanes(float *to, FloatLanes lanes)
+{
+    memcpy(to, &lanes, sizeof lanes);
+}
+
+inline FloatLanes maxLanes(FloatLanes lhs, FloatLanes rhs)
+{
+    return lhs > rhs ? lhs : rhs;
+}
+
+// 1 / sqrt(x) for x > 0: bit level estimate refined by three Newton steps,
+// relative error within a few float ulps
+inline FloatLanes rsqrtLanes(FloatLanes x)
+{
+    FloatLanes y = (FloatLanes)(0x5f375a86 - ((IntLanes)x >> 1));
+    for (int step = 0; step != 3; ++step)
+        y = y * (1.5f - 0.5f * x * y * y);
+    return y;
+}
+
+// log2(x) for x > 0 (normal floats): x = m 2^e with m in [sqrt(1/2),
+// sqrt(2)), log2(m) from the series of atanh((m - 1) / (m + 1)).
+// Absolute error below 3e-8 (plus float rounding of the result).
+inline FloatLanes log2Lanes(FloatLanes x)
+{
+    IntLanes bits = (IntLanes)x;
+    IntLanes exponent = ((bits >> 23) & 0xff) - 127;
+    FloatLanes m = (FloatLanes)((bits & 0x007fffff) | 0x3f800000);
+
+    IntLanes large = m > 1.41421356f;       // -1 (true) or 0 per lane
+    m = large ? 0.5f * m : m;
+    exponent -= large;
+
+    FloatLanes t = (m - 1.0f) / (m + 1.0f);
+    FloatLanes t2 = t * t;
+    FloatLanes series = 1.0f + t2 * (1.0f / 3 + t2 * (1.0f / 5
+                                + t2 * (1.0f / 7 + t2 * (1.0f / 9))));
+    return __builtin_convertvector(exponent, FloatLanes)
+           + 2.8853900817779268f * t * series;      // 2 / ln(2)
+}
+
+// 2^y for y <= 0: y = i + f with f in [-1/2, 1/2], 2^f from its degree 7
+// Taylor polynomial (relative error below 2e-8), 0 below 2^-126
+inline FloatLanes exp2Lanes(FloatLanes y)
+{
+    IntLanes whole = __builtin_convertvector(y - 0.5f, IntLanes);
+    FloatLanes f = y - __builtin_convertvector(whole, FloatLanes);
+
+    float const c1 = 0.69314718f;    // ln(2)^k / k!
+    float const c2 = 0.24022651f;
+    float const c3 = 0.05550411f;
+    float const c4 = 0.00961813f;
+    float const c5 = 0.00133336f;
+    float const c6 = 0.00015404f;
+    float const c7 = 0.00001525f;
+    FloatLanes power = 1.0f + f * (c1 + f * (c2 + f * (c3 + f * (c4
+                                 + f * (c5 + f * (c6 + f * c7))))));
+
+    FloatLanes scale = (FloatLanes)((whole + 127) << 23);
+    return y < -126.0f ? splat(0) : power * scale;
+}
+
+// x^n for x in [0, 1] and n >= 0, matching pow for x = 0 (1 if n is 0,
+// else 0). Absolute error below 2e-7 for x given exactly (measured for n
+// up to 1024); an error in x grows about n times, see Scene::shadeBatch.
+inline FloatLanes powLanes(FloatLanes x, FloatLanes n)
+{
+    FloatLanes safe = x > 1e-30f ? x : splat(1);
+    FloatLanes power = exp2Lanes(n * log2Lanes(safe));
+    FloatLanes zero = n == 0.0f ? splat(1) : splat(0);
+    return x > 1e-30f ? power : zero;
+}
+
+#endif
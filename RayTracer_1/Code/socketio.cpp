@@ -0,0 +1,268 @@
+#include "socketio.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    runtime_error systemError(string const &what)
+    {
+        return runtime_error(what + ": " + strerror(errno));
+    }
+
+    bool isUnixAddress(string const &address)
+    {
+        return address.find('/') != string::npos;
+    }
+
+    sockaddr_un unixAddress(string const &path)
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            throw runtime_error("socket path too long: " + path);
+        strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+
+    bool connectUnix(int fd, string const &path)
+    {
+        sockaddr_un address = unixAddress(path);
+        return connect(fd, reinterpret_cast<sockaddr *>(&address),
+                       sizeof(address)) == 0;
+    }
+
+    // "host:port" -> addresses to try, host may be empty when listening
+    addrinfo *resolve(string const &address, bool listening)
+    {
+        size_t colon = address.rfind(':');
+        if (colon == string::npos)
+            throw runtime_error("expected host:port or a socket path: "
+                                + address);
+        string host = address.substr(0, colon);
+        string port = address.substr(colon + 1);
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+        addrinfo *found;
+        int error = getaddrinfo(host.empty() ? nullptr : host.c_str(),
+                                port.c_str(), &hints, &found);
+        if (error != 0)
+            throw runtime_error(address + ": " + gai_strerror(error));
+        return found;
+    }
+
+    // TCP: small messages (tile requests) are sent right away
+    void tuneTcp(int fd)
+    {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    }
+}
+
+int listenUnix(string const &path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw systemError("socket");
+
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0)
+    {
+        if (!S_ISSOCK(info.st_mode))
+        {
+            close(fd);
+            throw runtime_error(path + " exists and is not a socket");
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = connectUnix(probe, path);
+        close(probe);
+        if (live)
+        {
+            close(fd);
+            throw runtime_error("already serving on " + path);
+        }
+        unlink(path.c_str());
+    }
+
+    sockaddr_un where = unixAddress(path);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&where), sizeof(where)) != 0
+        || listen(fd, 64) != 0)
+    {
+        runtime_error error = systemError("listen on " + path);
+        close(fd);
+        throw error;
+    }
+    return fd;
+}
+
+void closeUnixListener(int fd, string const &path)
+{
+    close(fd);
+    unlink(path.c_str());
+}
+
+int listenSocket(string const &address)
+{
+    if (isUnixAddress(address))
+        return listenUnix(address);
+
+    addrinfo *found = resolve(address, true);
+    int fd = -1;
+    for (addrinfo *info = found; info && fd < 0; info = info->ai_next)
+    {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd < 0)
+            continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, info->ai_addr, info->ai_addrlen) != 0
+            || listen(fd, 64) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0)
+        throw systemError("listen on " + address);
+    return fd;
+}
+
+int connectSocket(string const &address)
+{
+    if (isUnixAddress(address))
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw systemError("socket");
+        if (!connectUnix(fd, address))
+        {
+            runtime_error error = systemError("connect to " + address);
+            close(fd);
+            throw error;
+        }
+        return fd;
+    }
+
+    addrinfo *found = resolve(address, false);
+    int fd = -1;
+    for (addrinfo *info = found; info && fd < 0; info = info->ai_next)
+    {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0)
+        throw systemError("connect to " + address);
+    tuneTcp(fd);
+    return fd;
+}
+
+void setSendTimeout(int fd, unsigned seconds)
+{
+    timeval timeout{static_cast<time_t>(seconds), 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                   sizeof(timeout)) != 0)
+        throw systemError("SO_SNDTIMEO");
+}
+
+void closeListener(int fd, string const &address)
+{
+    if (isUnixAddress(address))
+        closeUnixListener(fd, address);
+    else
+        close(fd);
+}
+
+bool readLine(int fd, string &buffer, string &line, size_t maxLength)
+{
+    size_t searched = 0;
+    while (true)
+    {
+        size_t newline = buffer.find('\n', searched);
+        if (newline != string::npos)
+        {
+            line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
+        }
+        if (buffer.size() > maxLength)
+            return false;
+        searched = buffer.size();
+        if (!readMore(fd, buffer))
+            return false;
+    }
+}
+
+bool readMore(int fd, string &buffer)
+{
+    char chunk[65536];
+    while (true)
+    {
+        ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        buffer.append(chunk, count);
+        return true;
+    }
+}
+
+bool writeAll(int fd, string const &data)
+{
+    for (size_t done = 0; done != data.size(); )
+    {
+        ssize_t count = send(fd, data.data() + done, data.size() - done,
+                             MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        done += count;
+    }
+    return true;
+}
+
+void appendDouble(string &data, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (unsigned byte = 0; byte != 8; ++byte)
+        data += static_cast<char>(bits >> (8 * byte) & 0xff);
+}
+
+double readDouble(char const *data)
+{
+    uint64_t bits = 0;
+    for (unsigned byte = 0; byte != 8; ++byte)
+        bits |= static_cast<uint64_t>(static_cast<unsigned char>(data[byte]))
+                << (8 * byte);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
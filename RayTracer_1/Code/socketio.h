@@ -0,0 +1,50 @@
+#ifndef SOCKETIO_H_
+#define SOCKETIO_H_
+
+#include <cstddef>
+#include <string>
+
+// Helpers around stream sockets, shared by the render daemon and the
+// distributed renderer. An address containing a '/' is the path of a Unix
+// domain socket, any other address is "host:port" for TCP (the host may
+// be left out when listening). Functions that set up sockets throw
+// runtime_error, functions that transfer data return false on errors and
+// at end of file.
+
+// listening socket, a stale Unix socket file left by a crashed server is
+// replaced, one that still accepts connections is not, and neither is a
+// file that is not a socket
+int listenSocket(std::string const &address);
+
+// listening Unix domain socket at path, whether it has a '/' or not (for
+// local services that must not be reachable over the network). A stale
+// socket file is replaced, see listenSocket.
+int listenUnix(std::string const &path);
+
+// closes a socket made by listenUnix, removing its socket file
+void closeUnixListener(int fd, std::string const &path);
+
+int connectSocket(std::string const &address);
+
+// makes sends on fd fail (writeAll returns false) when the peer takes
+// more than seconds to make room for more data
+void setSendTimeout(int fd, unsigned seconds);
+
+// closes a socket made by listenSocket, removing its Unix socket file
+void closeListener(int fd, std::string const &address);
+
+// reads up to the next newline (not included in line), extra data that
+// was read stays in buffer. Fails if no newline shows up in maxLength bytes.
+bool readLine(int fd, std::string &buffer, std::string &line,
+              size_t maxLength);
+
+// reads more data into buffer, as much as is available at once
+bool readMore(int fd, std::string &buffer);
+
+bool writeAll(int fd, std::string const &data);
+
+// doubles as 8 little endian bytes, the same on every machine
+void appendDouble(std::string &data, double value);
+double readDouble(char const *data);
+
+#endif
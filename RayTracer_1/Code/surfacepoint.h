@@ -0,0 +1,21 @@
+#ifndef SURFACEPOINT_H_
+#define SURFACEPOINT_H_
+
+#include "triple.h"
+
+// First hit of a primary ray: everything needed to shade it again
+class SurfacePoint
+{
+    public:
+        Point position;     // hit point
+        Vector N;           // normal, facing the viewer
+        Vector V;           // view vector, towards the eye
+        int object = -1;    // index of the hit object, -1: none
+        bool inside = false;    // hit from the back (inside the object)
+        double u = 0;           // texture coordinates
+        double v = 0;
+        double footprint = 0;   // width of a pixel around the hit, in
+                                // texture units
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "texture.h"
+
+#include "image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    unsigned const TILE_LOG2 = 3;           // 8 x 8 texel tiles
+    unsigned const TILE = 1 << TILE_LOG2;
+
+    // a coordinate inside a tile with a zero bit between its bits: the
+    // Morton index of texel (x, y) is SPREAD[x] + 2 * SPREAD[y]
+    unsigned const SPREAD[TILE] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+    // float -> IEEE half, rounding to nearest
+    uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof bits);
+        uint16_t sign = (bits >> 16) & 0x8000;
+        bits &= 0x7fffffff;
+
+        if (bits >= 0x47800000)             // too large, infinite or NaN
+            return sign | (bits > 0x7f800000 ? 0x7e00 : 0x7c00);
+        if (bits < 0x38800000)              // below 2^-14: subnormal
+        {
+            if (bits < 0x33000000)          // below 2^-25: 0
+                return sign;
+            unsigned shift = 126 - (bits >> 23);
+            uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+            return sign | ((mantissa + (1 << (shift - 1))) >> shift);
+        }
+        // rebias the exponent, round the mantissa to 10 bits (to even)
+        uint32_t rounded = bits + 0xfff + ((bits >> 13) & 1);
+        return sign | ((rounded - 0x38000000) >> 13);
+    }
+
+    float fromHalf(uint16_t half)
+    {
+        uint32_t sign = (half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+        if (exponent == 0)
+        {
+            float value = ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -value : value;
+        }
+
+        uint32_t bits = exponent == 0x1f
+                        ? sign | 0x7f800000 | (mantissa << 13)
+                        : sign | ((exponent + 112) << 23) | (mantissa << 13);
+        float value;
+        memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+
+    // Box filter: every texel of the smaller level averages the texels of
+    // the larger one it covers (also for odd sizes)
+    vector<float> shrink(vector<float> const &rgb, unsigned width,
+                         unsigned height, unsigned newWidth,
+                         unsigned newHeight)
+    {
+        vector<float> result(3 * newWidth * newHeight);
+        for (unsigned y = 0; y != newHeight; ++y)
+        {
+            unsigned y0 = y * height / newHeight;
+            unsigned y1 = ((y + 1) * height + newHeight - 1) / newHeight;
+            for (unsigned x = 0; x != newWidth; ++x)
+            {
+                unsigned x0 = x * width / newWidth;
+                unsigned x1 = ((x + 1) * width + newWidth - 1) / newWidth;
+                float sum[3] = {0, 0, 0};
+                for (unsigned sy = y0; sy != y1; ++sy)
+                    for (unsigned sx = x0; sx != x1; ++sx)
+                    {
+                        float const *texel = &rgb[3 * (sy * width + sx)];
+                        for (unsigned channel = 0; channel != 3; ++channel)
+                            sum[channel] += texel[channel];
+                    }
+                float count = (y1 - y0) * (x1 - x0);
+                for (unsigned channel = 0; channel != 3; ++channel)
+                    result[3 * (y * newWidth + x) + channel] =
+                        sum[channel] / count;
+            }
+        }
+        return result;
+    }
+
+    // texel index of coordinate (already floored) c, wrapped into [0, size)
+    unsigned wrap(double c, unsigned size)
+    {
+        double wrapped = c - size * floor(c / size);
+        return min(static_cast<unsigned>(wrapped), size - 1);
+    }
+}
+
+bool parseTextureFormat(string const &name, Texture::Format &format)
+{
+    if (name == "byte")
+        format = Texture::BYTE;
+    else if (name == "half")
+        format = Texture::HALF;
+    else
+        return false;
+    return true;
+}
+
+Texture::Texture(Image const &image, Format format)
+:
+    d_format(format)
+{
+    build(image);
+}
+
+Texture::Texture(string const &filename, Format format)
+:
+    Texture(Image(filename), format)
+{}
+
+size_t Texture::bytes() const
+{
+    return d_bytes.size() + d_halves.size() * sizeof(uint16_t);
+}
+
+double Texture::lod(double footprint) const
+{
+    Level const &full = d_levels[0];
+    double texels = footprint * max(full.width, full.height);
+    return texels > 1 ? log2(texels) : 0;
+}
+
+Color Texture::bilinear(double u, double v, unsigned level) const
+{
+    Level const &lv = d_levels[min<size_t>(level, d_levels.size() - 1)];
+
+    // texel centres at half integers, v pointing up
+    double s = u * lv.width - 0.5;
+    double t = (1 - v) * lv.height - 0.5;
+    double sFloor = floor(s);
+    double tFloor = floor(t);
+    float fs = s - sFloor;
+    float ft = t - tFloor;
+
+    unsigned x0 = wrap(sFloor, lv.width);
+    unsigned y0 = wrap(tFloor, lv.height);
+    unsigned x1 = x0 + 1 == lv.width ? 0 : x0 + 1;
+    unsigned y1 = y0 + 1 == lv.height ? 0 : y0 + 1;
+
+    float c00[3], c10[3], c01[3], c11[3];
+    texel(texelIndex(lv, x0, y0), c00);
+    texel(texelIndex(lv, x1, y0), c10);
+    texel(texelIndex(lv, x0, y1), c01);
+    texel(texelIndex(lv, x1, y1), c11);
+
+    Color color;
+    for (unsigned channel = 0; channel != 3; ++channel)
+    {
+        float top = c00[channel] + fs * (c10[channel] - c00[channel]);
+        float bottom = c01[channel] + fs * (c11[channel] - c01[channel]);
+        color.data[channel] = top + ft * (bottom - top);
+    }
+    return color;
+}
+
+Color Texture::sample(double u, double v, double lod) const
+{
+    double last = d_levels.size() - 1;
+    if (!(lod > 0))                     // also for NaN
+        return bilinear(u, v, 0);
+    if (lod >= last)
+        return bilinear(u, v, last);
+
+    unsigned level = static_cast<unsigned>(lod);
+    double weight = lod - level;
+    Color fine = bilinear(u, v, level);
+    return fine + weight * (bilinear(u, v, level + 1) - fine);
+}
+
+void Texture::build(Image const &image)
+{
+    unsigned width = image.width();
+    unsigned height = image.height();
+    if (width == 0 || height == 0)
+        throw invalid_argument("Texture: the image is empty");
+
+    size_t texels = 0;
+    while (true)
+    {
+        unsigned tilesX = (width + TILE - 1) / TILE;
+        unsigned tilesY = (height + TILE - 1) / TILE;
+        d_levels.push_back(Level{width, height, tilesX, texels});
+        texels += static_cast<size_t>(tilesX) * tilesY * TILE * TILE;
+        if (width == 1 && height == 1)
+            break;
+        width = max(width / 2, 1u);
+        height = max(height / 2, 1u);
+    }
+    if (d_format == BYTE)
+        d_bytes.assign(4 * texels, 0);
+    else
+        d_halves.assign(4 * texels, 0);
+
+    vector<float> rgb(image.data(), image.data() + 3 * image.size());
+    store(0, rgb);
+    for (unsigned level = 1; level != d_levels.size(); ++level)
+    {
+        Level const &larger = d_levels[level - 1];
+        Level const &smaller = d_levels[level];
+        rgb = shrink(rgb, larger.width, larger.height, smaller.width,
+                     smaller.height);
+        store(level, rgb);
+    }
+}
+
+void Texture::store(unsigned level, vector<float> const &rgb)
+{
+    Level const &lv = d_levels[level];
+    for (unsigned y = 0; y != lv.height; ++y)
+        for (unsigned x = 0; x != lv.width; ++x)
+        {
+            size_t index = 4 * texelIndex(lv, x, y);
+            float const *color = &rgb[3 * (y * lv.width + x)];
+            for (unsigned channel = 0; channel != 3; ++channel)
+            {
+                if (d_format == HALF)
+                    d_halves[index + channel] = toHalf(color[channel]);
+                else
+                    d_bytes[index + channel] = static_cast<uint8_t>(
+                        min(max(color[channel], 0.0f), 1.0f) * 255 + 0.5f);
+            }
+        }
+}
+
+size_t Texture::texelIndex(Level const &level, unsigned x, unsigned y) const
+{
+    size_t tile = (y >> TILE_LOG2) * level.tilesX + (x >> TILE_LOG2);
+    return level.offset + tile * TILE * TILE + SPREAD[x & (TILE - 1)]
+           + 2 * SPREAD[y & (TILE - 1)];
+}
+
+void Texture::texel(size_t index, float rgb[3]) const
+{
+    if (d_format == HALF)
+    {
+        uint16_t const *texel = &d_halves[4 * index];
+        for (unsigned channel = 0; channel != 3; ++channel)
+            rgb[channel] = fromHalf(texel[channel]);
+    }
+    else
+    {
+        uint8_t const *texel = &d_bytes[4 * index];
+        for (unsigned channel = 0; channel != 3; ++channel)
+            rgb[channel] = texel[channel] * (1.0f / 255);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include "triple.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Image;
+
+// Color map for materials, built from a PNG. Stores a mip chain (every
+// level half the size of the one before, down to 1 x 1) of 8 bit or half
+// float RGB texels, padded to 4 channels. Each level is cut into 8 x 8
+// texel tiles that lie one after the other, the texels inside a tile in
+// Morton order, so the texels of a lookup (and of nearby lookups) share
+// cache lines whichever direction the lookups move in.
+//
+// Texture coordinates wrap around, (0, 0) is the bottom left corner of
+// the image, (1, 1) the top right one. Values are taken as linear colors,
+// as the renderer writes them.
+class Texture
+{
+    public:
+        enum Format
+        {
+            BYTE,           // 8 bits per channel, 4 bytes per texel
+            HALF            // 16 bit floats, 8 bytes per texel
+        };
+
+    private:
+        struct Level
+        {
+            unsigned width;
+            unsigned height;
+            unsigned tilesX;    // tiles per row
+            size_t offset;      // of the first texel in d_bytes / d_halves
+        };
+
+        Format d_format;
+        std::vector<Level> d_levels;        // d_levels[0]: full size
+        std::vector<uint8_t> d_bytes;       // BYTE texels
+        std::vector<uint16_t> d_halves;     // HALF texels
+
+    public:
+        Texture(Image const &image, Format format = BYTE);
+        Texture(std::string const &filename, Format format = BYTE);
+
+        Format format() const;
+        unsigned levels() const;
+        size_t bytes() const;               // texel storage, all levels
+
+        // mip level for a lookup covering footprint texture units (the
+        // width of a pixel projected onto the texture): 0 for a footprint
+        // of a texel or less, 1 for two texels, and so on
+        double lod(double footprint) const;
+
+        // bilinear filtered color at (u, v) in one level
+        Color bilinear(double u, double v, unsigned level) const;
+
+        // trilinear: blends the bilinear colors of the two levels around
+        // lod (clamped to the chain)
+        Color sample(double u, double v, double lod) const;
+
+    private:
+        void build(Image const &image);
+        void store(unsigned level, std::vector<float> const &rgb);
+        size_t texelIndex(Level const &level, unsigned x, unsigned y) const;
+        void texel(size_t index, float rgb[3]) const;
+};
+
+inline Texture::Format Texture::format() const
+{
+    return d_format;
+}
+
+inline unsigned Texture::levels() const
+{
+    return d_levels.size();
+}
+
+// "byte" or "half" -> Format, false if unknown
+bool parseTextureFormat(std::string const &name, Texture::Format &format);
+
+#endif
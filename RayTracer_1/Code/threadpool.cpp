@@ -0,0 +1,133 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+using namespace std;
+
+namespace
+{
+    // Shared by the caller of parallelFor and its helper tasks, helpers
+    // that start late find no work left and return immediately.
+    struct LoopState
+    {
+        function<void(size_t)> body;
+        size_t count;
+        atomic<size_t> next;
+        atomic<size_t> done;
+        mutex lock;
+        condition_variable finished;
+        exception_ptr error;
+
+        void run()
+        {
+            for (size_t idx = next++; idx < count; idx = next++)
+            {
+                try
+                {
+                    body(idx);
+                }
+                catch (...)
+                {
+                    lock_guard<mutex> guard(lock);
+                    if (!error)
+                        error = current_exception();
+                }
+                if (++done == count)
+                {
+                    lock_guard<mutex> guard(lock);
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+:
+    d_stopping(false)
+{
+    if (threads == 0)
+        threads = thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned idx = 0; idx != threads; ++idx)
+        d_workers.push_back(thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(d_mutex);
+        d_stopping = true;
+    }
+    d_wakeup.notify_all();
+    for (thread &worker : d_workers)
+        worker.join();
+}
+
+future<void> ThreadPool::submit(function<void()> task)
+{
+    packaged_task<void()> packaged(move(task));
+    future<void> result = packaged.get_future();
+    {
+        lock_guard<mutex> guard(d_mutex);
+        d_tasks.push_back(move(packaged));
+    }
+    d_wakeup.notify_one();
+    return result;
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             function<void(size_t)> const &body)
+{
+    if (count == 0)
+        return;
+
+    auto state = make_shared<LoopState>();
+    state->body = body;
+    state->count = count;
+    state->next = 0;
+    state->done = 0;
+
+    size_t helpers = min<size_t>(d_workers.size(), count - 1);
+    for (size_t idx = 0; idx != helpers; ++idx)
+        submit([state]() { state->run(); });
+
+    state->run();
+
+    unique_lock<mutex> guard(state->lock);
+    state->finished.wait(guard, [&state]()
+                         {
+                             return state->done == state->count;
+                         });
+    if (state->error)
+        rethrow_exception(state->error);
+}
+
+unsigned ThreadPool::size() const
+{
+    return d_workers.size();
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        packaged_task<void()> task;
+        {
+            unique_lock<mutex> guard(d_mutex);
+            d_wakeup.wait(guard, [this]() {
+                return d_stopping || !d_tasks.empty();
+            });
+            if (d_tasks.empty())
+                return;     // stopping and nothing left to do
+            task = move(d_tasks.front());
+            d_tasks.pop_front();
+        }
+        task();
+    }
+}
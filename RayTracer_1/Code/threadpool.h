@@ -0,0 +1,44 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running submitted tasks in FIFO order
+class ThreadPool
+{
+    std::vector<std::thread> d_workers;
+    std::deque<std::packaged_task<void()>> d_tasks;
+    std::mutex d_mutex;
+    std::condition_variable d_wakeup;
+    bool d_stopping;
+
+    public:
+        // threads == 0: one worker per hardware thread
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(ThreadPool const &other) = delete;
+        ThreadPool &operator=(ThreadPool const &other) = delete;
+
+        std::future<void> submit(std::function<void()> task);
+
+        // calls body(0) ... body(count - 1) on the workers and the calling
+        // thread, returns when all calls are done. Safe to use from inside
+        // a task: the caller never waits for a worker to become free.
+        void parallelFor(size_t count,
+                         std::function<void(size_t)> const &body);
+
+        unsigned size() const;
+
+    private:
+        void work();
+};
+
+#endif
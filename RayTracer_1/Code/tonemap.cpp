@@ -0,0 +1,66 @@
+#include "tonemap.h"
+
+#include "simdmath.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    typedef uint8_t ByteLanes __attribute__((vector_size(LANES)));
+
+    // sRGB transfer function, linear below the knee
+    float const SRGB_KNEE = 0.0031308f;
+
+    ByteLanes mapLanes(FloatLanes value, float scale, ToneMap const &map)
+    {
+        // clamp to [0, 1] (NaN becomes 0)
+        value *= scale;
+        value = value > 0.0f ? value : splat(0);
+        if (map.op == ToneMap::REINHARD)
+            value /= 1.0f + value;
+        value = value < 1.0f ? value : splat(1);
+
+        if (map.srgb)
+            value = value > SRGB_KNEE
+                    ? 1.055f * powLanes(value, splat(1 / 2.4f)) - 0.055f
+                    : 12.92f * value;
+
+        IntLanes bytes = __builtin_convertvector(value * 255.0f, IntLanes);
+        return __builtin_convertvector(bytes, ByteLanes);
+    }
+}
+
+bool parseToneOperator(string const &name, ToneMap::Operator &op)
+{
+    if (name == "clamp")
+        op = ToneMap::CLAMP;
+    else if (name == "reinhard")
+        op = ToneMap::REINHARD;
+    else
+        return false;
+    return true;
+}
+
+void toneMap(float const *linear, size_t count, unsigned char *out,
+             ToneMap const &map)
+{
+    float const scale = exp2(map.exposure);
+
+    size_t idx = 0;
+    for (; idx + LANES <= count; idx += LANES)
+    {
+        ByteLanes bytes = mapLanes(loadLanes(linear + idx), scale, map);
+        memcpy(out + idx, &bytes, LANES);
+    }
+
+    // last few values: through a zero padded vector
+    if (idx != count)
+    {
+        float rest[LANES] = {};
+        memcpy(rest, linear + idx, (count - idx) * sizeof(float));
+        ByteLanes bytes = mapLanes(loadLanes(rest), scale, map);
+        memcpy(out + idx, &bytes, count - idx);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef TONEMAP_H_
+#define TONEMAP_H_
+
+#include <cstddef>
+#include <string>
+
+// How the linear, unclamped colors of the framebuffer become 8 bit
+// output values: scaled by 2^exposure, compressed (CLAMP keeps values up
+// to 1 as they are, REINHARD maps x to x / (1 + x) so highlights keep
+// their detail), clamped to [0, 1], optionally sRGB encoded and scaled
+// to 0...255 (truncating, as the framework always did).
+struct ToneMap
+{
+    enum Operator
+    {
+        CLAMP,
+        REINHARD
+    };
+
+    Operator op = CLAMP;
+    float exposure = 0;     // stops
+    bool srgb = false;      // false: store linear values
+};
+
+// "clamp" or "reinhard" -> operator, false if unknown
+bool parseToneOperator(std::string const &name, ToneMap::Operator &op);
+
+// Converts count floats (any number of channels, all treated alike) to
+// bytes, several at once in vector registers (see simdmath.h)
+void toneMap(float const *linear, size_t count, unsigned char *out,
+             ToneMap const &map);
+
+#endif
@@ -0,0 +1,115 @@
+#include "worker.h"
+
+#include "image.h"
+#include "raytracer.h"
+#include "socketio.h"
+#include "threadpool.h"
+
+#include "json/json.h"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    size_t const MAX_MESSAGE = 256 << 20;   // bytes, the scene included
+    unsigned const CONNECT_ATTEMPTS = 100;  // 10 s for a coordinator to start
+
+    // the coordinator may not be listening yet
+    int connectWithRetry(string const &address)
+    {
+        for (unsigned attempt = 1; ; ++attempt)
+        {
+            try
+            {
+                return connectSocket(address);
+            }
+            catch (exception const &)
+            {
+                if (attempt == CONNECT_ATTEMPTS)
+                    throw;
+                this_thread::sleep_for(chrono::milliseconds(100));
+            }
+        }
+    }
+}
+
+TileWorker::TileWorker(RenderOptions const &options)
+:
+    d_options(options)
+{}
+
+bool TileWorker::run(string const &address)
+try
+{
+    int fd = connectWithRetry(address);
+    string buffer;
+    string line;
+    if (!readLine(fd, buffer, line, MAX_MESSAGE))
+        throw runtime_error("no job from the coordinator");
+
+    json job = json::parse(line);
+    RenderOptions options;
+    for (auto const &option : job["options"].items())
+        parseRenderOption("--" + option.key(), option.value().get<string>(),
+                          options);
+
+    ThreadPool pool(d_options.threads);
+    Raytracer raytracer;
+    raytracer.useThreadPool(pool);
+    istringstream scene(job.at("scene").dump());
+    if (!raytracer.readScene(scene))
+    {
+        writeAll(fd, json{{"error", "reading the scene failed"}}.dump()
+                     + '\n');
+        close(fd);
+        return false;
+    }
+    writeAll(fd, "{\"ready\":true}\n");
+
+    unsigned tiles = 0;
+    while (readLine(fd, buffer, line, MAX_MESSAGE))
+    {
+        json request = json::parse(line);
+        if (request.count("done"))
+            break;
+
+        Tile tile{request.at("x"), request.at("y"),
+                  request.at("width"), request.at("height")};
+        Image img = raytracer.renderWindow(tile, options);
+
+        string pixels;
+        pixels.reserve(img.size() * 24);
+        for (unsigned y = 0; y != img.height(); ++y)
+        {
+            for (unsigned x = 0; x != img.width(); ++x)
+            {
+                Color const &col = img(x, y);
+                appendDouble(pixels, col.r);
+                appendDouble(pixels, col.g);
+                appendDouble(pixels, col.b);
+            }
+        }
+        json reply{{"tile", request.at("tile")}, {"bytes", pixels.size()}};
+        if (!writeAll(fd, reply.dump() + '\n' + pixels))
+            break;
+        ++tiles;
+    }
+    close(fd);
+    cout << "Rendered " << tiles << " tiles.\n";
+    return true;
+}
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return false;
+}
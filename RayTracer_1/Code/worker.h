@@ -0,0 +1,21 @@
+#ifndef WORKER_H_
+#define WORKER_H_
+
+#include "renderoptions.h"
+
+#include <string>
+
+// Distributed rendering, worker side: connects to a TileCoordinator,
+// loads the scene it sends and renders tiles until the frame is done
+class TileWorker
+{
+    RenderOptions const &d_options;     // threads for the tiles
+
+    public:
+        explicit TileWorker(RenderOptions const &options);
+
+        // works for the coordinator at address, returns false on errors
+        bool run(std::string const &address);
+};
+
+#endif